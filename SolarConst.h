@@ -0,0 +1,114 @@
+/* SolarConst.h
+ * Released into the public domain (originally based on U.S. Govt. products)
+ * No warranty given or implied.
+ *
+ * Sunrise, solar noon and sunset tables worked out by the compiler. With a
+ * C++14 compiler the solar engine is constexpr, so a table for a fixed site
+ * and range of days can be built at compile time and stored in flash, and
+ * nothing needs to be calculated at startup:
+ *
+ * 		// Monterey, California, 365 days from 2024-1-1 (day 19723)
+ * 		constexpr SolarDayTable<365> table(19723, -8, 36.62, -121.904);
+ * 		time_t rise = table.sunrise[day - table.firstDay];
+ *
+ * On AVR boards add PROGMEM to the declaration to keep the table out of RAM,
+ * and read it back with pgm_read_dword().
+ *
+ * FixedSite does the same for the site itself: the trig of a latitude fixed
+ * at compile time is folded into constants for calcSolarSite().
+ *
+ * The values are those of calcSolarDay(), calculated with the series in
+ * SolarConstMath instead of the math library; they agree to within a
+ * millisecond. The site must have a sunrise and sunset on every day in the
+ * table. On a day of polar night or midnight sun the hour angle is not a
+ * number, and the compiler stops with an error instead of storing a bad
+ * time.
+ */
+#ifndef SolarConst_h
+#define SolarConst_h
+
+#include "SolarEngine.h"
+
+#if defined(SOLAR_HAS_CONSTEXPR)
+
+// Values for one day (days since 1970-1-1), as calcSolarDay()
+constexpr SolarDay solarDayConst(long unixDays, int tzOffset, double lat,
+                                 double lon){
+    SolarDay SD = {};
+    SolarLatLon<double, SolarConstMath<double> > site = { tzOffset, lat, lon };
+    solarDay<double, SolarConstMath<double> >(unixDays, site, SD);
+    return SD;
+}
+
+// Solar noon, sunrise and sunset (local time, seconds since 1970-1-1) for N
+// days starting at firstDay
+template <int N>
+struct SolarDayTable {
+    long firstDay;
+    time_t noon[N];
+    time_t sunrise[N];
+    time_t sunset[N];
+
+    constexpr SolarDayTable(long firstDay, int tzOffset, double lat,
+                            double lon)
+        : firstDay(firstDay), noon(), sunrise(), sunset() {
+        for (int i = 0; i < N; i++) {
+            SolarDay SD = solarDayConst(firstDay + i, tzOffset, lat, lon);
+            noon[i] = SD.SolarNoonTime;
+            sunrise[i] = SD.SunriseTime;
+            sunset[i] = SD.SunsetTime;
+        }
+    }
+};
+
+// A site fixed at compile time. Latitude and longitude are given in
+// millionths of a degree, since template parameters cannot be floating
+// point. The sine, cosine and tangent of the latitude are constants, so
+// calcSolarSite() has no trig of its own to do for the site:
+//
+// 		typedef FixedSite<36620000, -121904000, -8> Monterey;
+// 		calcSolarSite<Monterey>(t, SE);
+template <long LatE6, long LonE6, int Tz>
+struct FixedSite {
+    static constexpr double latDeg = LatE6 / 1e6;
+    static constexpr double lonDeg = LonE6 / 1e6;
+    static constexpr double sinLatV =
+        SolarConstMath<double>::sin(latDeg * DEG_TO_RAD);
+    static constexpr double cosLatV =
+        SolarConstMath<double>::cos(latDeg * DEG_TO_RAD);
+    static constexpr double tanLatV =
+        SolarConstMath<double>::tan(latDeg * DEG_TO_RAD);
+    static constexpr double cosHorizonV =
+        SolarConstMath<double>::cos(90.833 * DEG_TO_RAD);
+
+    static constexpr int tzOffset() { return Tz; }
+    static constexpr double lat() { return latDeg; }
+    static constexpr double lon() { return lonDeg; }
+    static constexpr double sinLat() { return sinLatV; }
+    static constexpr double cosLat() { return cosLatV; }
+    static constexpr double tanLat() { return tanLatV; }
+    static constexpr double lonMinutes() { return 4 * lonDeg; }
+    static constexpr double tzDays() { return Tz / 24.0; }
+    static constexpr double cosHorizon() { return cosHorizonV; }
+};
+
+// calcSolar() for a FixedSite. The site fields of SE are filled in from
+// Site, and only the stages needed for the fields in mask are calculated.
+template <class Site, typename T>
+void calcSolarSite(time_t t, SolarElementsT<T> &SE,
+                   unsigned int mask = SOLAR_ALL){
+    SE.tzOffset = Site::tzOffset();
+    SE.lat = (T)Site::lat();
+    SE.lon = (T)Site::lon();
+    solarStages<T, SolarLibm<T> >(t, SE, Site(), solarResolveMask(mask));
+}
+
+// calcSolarDay() for a FixedSite
+template <class Site, typename T>
+void calcSolarDaySite(long unixDays, SolarDayT<T> &SD){
+    solarDay<T, SolarLibm<T> >(unixDays, Site(), SD);
+}
+
+#endif // SOLAR_HAS_CONSTEXPR
+
+#endif
@@ -0,0 +1,502 @@
+/* SolarEngine.h
+ * Released into the public domain (originally based on U.S. Govt. products)
+ * No warranty given or implied.
+ *
+ * The NOAA solar equations used by calcSolar() and friends, written as
+ * templates on the scalar type T and the math functions M (see SolarMath.h).
+ * They live in a header, rather than in Solarlib.cpp, so that with C++14 they
+ * are constexpr and the compiler can run them at build time (SolarConst.h).
+ * Most sketches only need Solarlib.h.
+ */
+#ifndef SolarEngine_h
+#define SolarEngine_h
+
+#include "Solarlib.h"
+#include "SolarMath.h"
+
+// Sine and cosine of an angle d of at most 0.04 radian (2.3 degrees), to
+// 1e-11, from the first terms of their series
+template <typename T>
+SOLAR_CONSTEXPR void solarSinCosSmall(T d, T &s, T &c){
+    T z = d * d;
+    s = d * (1 - z * T(1.0 / 6) * (1 - z * T(1.0 / 20)));
+    c = 1 - z * T(0.5) * (1 - z * T(1.0 / 12));
+}
+
+// The stages after SOLAR_MEAN of solarEphemerisStages(), for the
+// SOLAR_TIER_FINE and SOLAR_TIER_COARSE math. The same equations,
+// rearranged so that only three angles need an argument reduction, where
+// the equations as written make sixteen calls: the sines and cosines of
+// GMAS, GMLS and the longitude of the Moon's node are worked out once by
+// M::sincos(), the multiple angles from them by the double-angle formulas,
+// and those of STA, SAL and OC by the angle-sum formulas from the small
+// angle each differs from one of them by (SEC, SAL - GMLS, OC - 23.44).
+// Each stage still works from the fields of SE alone, so any one can be run
+// by itself.
+template <typename T, class M, class E>
+SOLAR_CONSTEXPR void solarEphemerisTier(E &SE, unsigned int stages){
+    const T D2R = T(DEG_TO_RAD);
+    const T R2D = T(RAD_TO_DEG);
+    T sG = 0, cG = 0, sL = 0, cL = 0;
+    if (stages & (SOLAR_CENTER | SOLAR_EOT)) {
+        M::sincos(SE.GMAS * D2R, sG, cG);
+    }
+    if (stages & (SOLAR_DECLINATION | SOLAR_EOT)) {
+        M::sincos(SE.GMLS * D2R, sL, cL);
+    }
+    if (stages & SOLAR_CENTER) {
+        // Sun Equation of Center
+        SE.SEC = sG * (T(1.914602) -
+                       (SE.JCN * (T(0.004817) + T(0.000014) * SE.JCN))) +
+                 2 * sG * cG * (T(0.019993) - T(0.000101) * SE.JCN) +
+                 sG * (3 - 4 * sG * sG) * T(0.000289);
+        // Sun True Longitude (degrees)
+        SE.STL = SE.GMLS + SE.SEC;
+        // Sun True Anomaly (degrees)
+        SE.STA = SE.GMAS + SE.SEC;
+        // Sun Radian Vector (Astronomical Units)
+        T sC = 0, cC = 0;
+        solarSinCosSmall(SE.SEC * D2R, sC, cC);
+        SE.SRV = (T(1.000001018) * (1- SE.EEO * SE.EEO))/(1 + SE.EEO *
+                                              (cG * cC - sG * sC));
+    }
+    if (stages & SOLAR_OBLIQUITY) {
+        T sN = 0, cN = 0;
+        M::sincos((T(125.04) - T(1934.136) * SE.JCN) * D2R, sN, cN);
+        // Sun Apparent Longitude (degrees)
+        SE.SAL = SE.STL - T(0.00569) - T(0.00478) * sN;
+        // Mean Oblique Ecliptic (degrees)
+        SE.MOE = 23 + (26 + (T(21.448) - SE.JCN * (T(46.815) + SE.JCN *
+                            (T(0.00059) - SE.JCN * T(0.001813))))/60)/60;
+        // Oblique correction (degrees)
+        SE.OC = SE.MOE + T(0.00256) * cN;
+    }
+    T sOC = 0, cOC = 0;
+    if (stages & (SOLAR_DECLINATION | SOLAR_EOT)) {
+        T sd = 0, cd = 0;
+        solarSinCosSmall((SE.OC - T(23.44)) * D2R, sd, cd);
+        sOC = T(0.39778850739794974) * cd + T(0.91747714052291862) * sd;
+        cOC = T(0.91747714052291862) * cd - T(0.39778850739794974) * sd;
+    }
+    if (stages & SOLAR_DECLINATION) {
+        T sd = 0, cd = 0;
+        solarSinCosSmall((SE.SAL - SE.GMLS) * D2R, sd, cd);
+        T sA = sL * cd + cL * sd;
+        T cA = cL * cd - sL * sd;
+        // Sun Right Ascension (degrees)
+        SE.SRA = M::atan2(cOC * sA, cA) * R2D;
+        // Sun Declination (degrees)
+        SE.SDec = M::asin(sOC * sA) * R2D;
+    }
+    if (stages & SOLAR_EOT) {
+        // var y, which is tan(OC/2) squared
+        SE.vy = (1 - cOC) / (1 + cOC);
+        T s2L = 2 * sL * cL;
+        T c2L = 1 - 2 * sL * sL;
+        // Equation of Time (minutes)
+        SE.EOT = 4 * ((SE.vy * s2L -
+                    2 * SE.EEO * sG +
+                    4 * SE.EEO * SE.vy * sG * c2L -
+                    T(0.5) * SE.vy * SE.vy * 2 * s2L * c2L -
+                    T(1.25) * SE.EEO * SE.EEO * 2 * sG * cG) *
+                    R2D);
+    }
+}
+
+// Stages that depend only on the Julian Century Number. SE may be either a
+// SolarElementsT or a SolarEphemerisT, since both use the same field names.
+// Numeric constants are converted to T so that the float version is not
+// quietly promoted to double.
+template <typename T, class M, class E>
+SOLAR_CONSTEXPR void solarEphemerisStages(E &SE, unsigned int stages){
+    const T D2R = T(DEG_TO_RAD);
+    const T R2D = T(RAD_TO_DEG);
+    if (stages & (SOLAR_MEAN | SOLAR_CENTER | SOLAR_OBLIQUITY |
+                  SOLAR_DECLINATION | SOLAR_EOT)) {
+        SE.tier = M::tier;
+    }
+    if (stages & SOLAR_MEAN) {
+        // Geometric Mean Longitude of Sun (degrees)
+        SE.GMLS = (T(280.46646) + SE.JCN * (T(36000.76983) +
+                                            SE.JCN * T(0.0003032)));
+        // Finish GMLS calculation by calculating modolu(GMLS,360) as
+        // it's done in R or Excel. C's fmod doesn't work in the same
+        // way. The floor() function is from the math.h library.
+        SE.GMLS = SE.GMLS - (360 * (M::floor(SE.GMLS/360)) );
+        // Geometric Mean Anomaly of Sun (degrees)
+        SE.GMAS = T(357.52911) + (SE.JCN * (T(35999.05029) -
+                                            T(0.0001537) * SE.JCN));
+    
+        // Eccentricity of Earth Orbit
+        SE.EEO = T(0.016708634) - (SE.JCN * (T(0.000042037) +
+                                             T(0.0000001267) * SE.JCN));
+    }
+    if (M::tier != SOLAR_TIER_FULL) {
+        solarEphemerisTier<T, M>(SE, stages);
+        return;
+    }
+    if (stages & SOLAR_CENTER) {
+        // Sun Equation of Center
+        SE.SEC = M::sin(SE.GMAS * D2R) * (T(1.914602) -
+                            (SE.JCN * (T(0.004817) + T(0.000014) * SE.JCN))) +
+        M::sin((2*SE.GMAS) * D2R) * (T(0.019993) - T(0.000101) * SE.JCN) +
+        M::sin((3*SE.GMAS) * D2R) * T(0.000289);
+        // Sun True Longitude (degrees)
+        SE.STL = SE.GMLS + SE.SEC;
+        // Sun True Anomaly (degrees)
+        SE.STA = SE.GMAS + SE.SEC;
+        // Sun Radian Vector (Astronomical Units)
+        SE.SRV = (T(1.000001018) * (1- SE.EEO * SE.EEO))/(1 + SE.EEO *
+                                              M::cos(SE.STA * D2R));
+    }
+    if (stages & SOLAR_OBLIQUITY) {
+        // Sun Apparent Longitude (degrees)
+        SE.SAL = SE.STL - T(0.00569) - (T(0.00478) *
+                       M::sin((T(125.04) - T(1934.136) * SE.JCN) * D2R));
+        // Mean Oblique Ecliptic (degrees)
+        SE.MOE = 23 + (26 + (T(21.448) - SE.JCN * (T(46.815) + SE.JCN *
+                            (T(0.00059) - SE.JCN * T(0.001813))))/60)/60;
+        // Oblique correction (degrees)
+        SE.OC = SE.MOE + T(0.00256) *
+                M::cos((T(125.04) - T(1934.136) * SE.JCN) * D2R);
+    }
+    if (stages & SOLAR_DECLINATION) {
+        // Sun Right Ascension (degrees)
+        SE.SRA = (M::atan2(M::cos(SE.OC * D2R) * M::sin(SE.SAL * D2R),
+                           M::cos(SE.SAL * D2R))) * R2D;
+        // Sun Declination (degrees)
+        SE.SDec = (M::asin(M::sin(SE.OC * D2R) *
+                           M::sin(SE.SAL * D2R))) * R2D;
+    }
+    if (stages & SOLAR_EOT) {
+        // var y
+        SE.vy = M::tan((SE.OC/2) * D2R) * M::tan((SE.OC/2) * D2R);
+    
+        // Equation of Time (minutes)
+        SE.EOT = 4 * ((SE.vy * M::sin(2 * (SE.GMLS * D2R)) -
+                    2 * SE.EEO * M::sin(SE.GMAS * D2R) +
+                    4 * SE.EEO * SE.vy * M::sin(SE.GMAS * D2R) * 
+                    M::cos(2*(SE.GMLS * D2R)) -
+                    T(0.5) * SE.vy * SE.vy * M::sin(4*(SE.GMLS * D2R)) -
+                    T(1.25) * SE.EEO * SE.EEO * M::sin(2*(SE.GMAS * D2R))) * 
+                    R2D);
+    }
+}
+
+// A site given by its latitude and longitude in degrees. Every site type
+// passed to the engine has the same member functions; this one works out the
+// latitude terms each time they are asked for. See FixedSite in SolarConst.h
+// for one where the compiler does it.
+template <typename T, class M>
+struct SolarLatLon {
+    int tz;     // Time zone Offset, zones west of GMT are negative
+    T latDeg;   // Latitude (degrees), north is positive
+    T lonDeg;   // Longitude (degrees), west is negative
+
+    SOLAR_CONSTEXPR int tzOffset() const { return tz; }
+    SOLAR_CONSTEXPR T lat() const { return latDeg; }
+    SOLAR_CONSTEXPR T lon() const { return lonDeg; }
+    SOLAR_CONSTEXPR T sinLat() const { return M::sin(latDeg * T(DEG_TO_RAD)); }
+    SOLAR_CONSTEXPR T cosLat() const { return M::cos(latDeg * T(DEG_TO_RAD)); }
+    SOLAR_CONSTEXPR T tanLat() const { return M::tan(latDeg * T(DEG_TO_RAD)); }
+    // Longitude as a time offset (minutes)
+    SOLAR_CONSTEXPR T lonMinutes() const { return 4 * lonDeg; }
+    // Time zone offset (days)
+    SOLAR_CONSTEXPR T tzDays() const { return (T)tz / 24; }
+    // Cosine of the zenith angle of the sun at sunrise and sunset
+    SOLAR_CONSTEXPR T cosHorizon() const {
+        return M::cos(T(90.833) * T(DEG_TO_RAD));
+    }
+};
+
+// Approximate Atmospheric Refraction (seconds of arc) at elevation SEA
+// (degrees), given u = 1 / tan(SEA). Each piece of the NOAA formula is
+// worked out and the one for SEA picked with M::select() rather than an
+// if/else chain, which is mispredicted around sunrise and sunset, and the
+// odd powers of u are multiplied out instead of going through pow(). The
+// results agree with the chain of branches to within rounding.
+template <typename T, class M>
+SOLAR_CONSTEXPR T solarRefraction(T SEA, T u){
+    T high = u * (T(58.1) - u * u * (T(0.07) - T(0.000086) * u * u));
+    T low = 1735 + SEA * (T(-581.2) + SEA * (T(103.4) + SEA *
+                          (T(-12.79) + SEA * T(0.711))));
+    T AAR = M::select(SEA > T(-0.575), low, T(-20.772) * u);
+    AAR = M::select(SEA > 5, high, AAR);
+    return M::select(SEA > 85, T(0), AAR);
+}
+
+// Solar Azimuth Angle (degrees clockwise from North) from the sines and
+// cosines of the hour angle, declination and latitude. atan2() of the
+// azimuth's sine and cosine, measured from south, needs no branch on the
+// sign of the hour angle, and unlike acos() of the cosine alone it keeps
+// its precision near solar noon, when the sun is due south or north. Over
+// 1901 to 2099 it differs from the acos() form by at most 3e-8 degree
+// below 89 degrees elevation, which is the error of that form at noon.
+template <typename T, class M>
+SOLAR_CONSTEXPR T solarAzimuth(T sinHA, T cosHA, T sinDec, T cosDec, T sinLat,
+                               T cosLat){
+    const T R2D = T(RAD_TO_DEG);
+    T SAA = M::atan2(sinHA * cosDec,
+                     cosHA * sinLat * cosDec - sinDec * cosLat) * R2D + 180;
+    return SAA - 360 * M::floor(SAA / 360);
+}
+
+// Stages that depend on the site and the time of day. utcMinutes is the time
+// past midnight GMT in minutes; SDec and EOT come from the ephemeris for the
+// same instant.
+template <typename T, class M, class P, class S>
+SOLAR_CONSTEXPR void solarPositionStages(P &SE, T SDec, T EOT, T utcMinutes,
+                                         const S &site, unsigned int stages){
+    const T D2R = T(DEG_TO_RAD);
+    const T R2D = T(RAD_TO_DEG);
+    const T sinLat = T(site.sinLat());
+    const T cosLat = T(site.cosLat());
+    if (stages & (SOLAR_HOURANGLE | SOLAR_ZENITH | SOLAR_REFRACTION |
+                  SOLAR_AZIMUTH)) {
+        SE.tier = M::tier;
+    }
+    if (stages & SOLAR_HOURANGLE) {
+        // True Solar Time (minutes)
+        SE.TST = (utcMinutes + EOT + T(site.lonMinutes()));
+        // Finish TST calculation by calculating modolu(TST,360) as
+        // it's done in R or Excel. C's fmod doesn't work in the same
+        // way. The floor() function is from the math.h library.
+        SE.TST = SE.TST - (1440 * (M::floor(SE.TST/1440)) );
+        // Hour Angle (degrees). TST is now 0 to 1440, so this is the
+        // second half of NOAA's TST/4 < 0 test, with no branch and a NaN
+        // passed through rather than left unassigned.
+        SE.HA = SE.TST/4 - 180;
+    }
+    T sinDec = 0, cosDec = 0, sinHA = 0, cosHA = 0;
+    if (stages & (SOLAR_ZENITH | SOLAR_AZIMUTH)) {
+        M::sincos(SDec * D2R, sinDec, cosDec);
+        M::sincos(SE.HA * D2R, sinHA, cosHA);
+    }
+    if (stages & SOLAR_ZENITH) {
+        T cosZ = sinLat * sinDec + cosLat * cosDec * cosHA;
+        if (M::tier == SOLAR_TIER_FULL) {
+            // Solar Zenith Angle (degrees)
+            SE.SZA = (M::acos(cosZ)) * R2D;
+        } else {
+            // Near the zenith and nadir acos() magnifies the polynomials'
+            // error in cosZ; atan2() of the horizontal part over it does not
+            T east = sinHA * cosDec;
+            T north = cosHA * sinLat * cosDec - sinDec * cosLat;
+            SE.SZA = M::atan2(M::sqrt(east * east + north * north), cosZ) * R2D;
+        }
+        // Solar Elevation Angle (degrees above horizontal)
+        SE.SEA = 90 - SE.SZA;
+    }
+    if (stages & SOLAR_REFRACTION) {
+        // Approximate Atmospheric Refraction (degrees)
+        T sinSEA = 0, cosSEA = 0;
+        M::sincos(SE.SEA * D2R, sinSEA, cosSEA);
+        SE.AAR = solarRefraction<T, M>(SE.SEA, cosSEA / sinSEA) / 3600;
+        // Solar Elevation Corrected for Atmospheric
+        // refraction (degrees)
+        SE.SEC_Corr = SE.SEA + SE.AAR;
+    }
+    if (stages & SOLAR_AZIMUTH) {
+        // Solar Azimuth Angle (degrees clockwise from North)
+        SE.SAA = solarAzimuth<T, M>(sinHA, cosHA, sinDec, cosDec, sinLat,
+                                    cosLat);
+    }
+}
+
+// Whole-number division rounding toward minus infinity, so that times before
+// 1970 land in the right day
+template <typename I>
+SOLAR_CONSTEXPR I solarFloorDiv(I a, I b){
+    I q = a / b;
+    return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+}
+
+// Split a time value into whole days since 1970-1-1 and seconds past
+// midnight. Division truncates toward zero, so for times before 1970 step
+// back one day and wrap the remainder into 0..86399. This replaces the Time
+// library's hour(), minute() and second(), each of which breaks the time down
+// into a full calendar date.
+SOLAR_CONSTEXPR void solarSplitTime(time_t t, long &days, long &secs){
+    time_t d = t / 86400;
+    time_t r = t - d * 86400;
+    time_t neg = r < 0;
+    days = (long)(d - neg);
+    secs = (long)(r + neg * 86400);
+}
+
+// Split a count of milliseconds since 1970-1-1 into whole days and
+// milliseconds past midnight, as solarSplitTime() does for seconds
+SOLAR_CONSTEXPR void solarSplitMillis(int64_t ms, long &days, long &msOfDay){
+    int64_t d = ms / 86400000;
+    int64_t r = ms - d * 86400000;
+    int64_t neg = r < 0;
+    days = (long)(d - neg);
+    msOfDay = (long)(r + neg * 86400000);
+}
+
+// The same split in doubles, for loops over many time values: the compiler
+// vectorizes it, where it does each 64-bit division one at a time. The time
+// goes to a double in two 32-bit halves, since there is no vector conversion
+// from 64-bit integers before AVX-512. Within 2^53 ms (285,000 years) of 1970
+// every value is a whole number held exactly, and the quotient, when not a
+// whole number, is at least 1/86400000 away from one: more than half a unit
+// in the last place of a day count below 2^27, so its rounding never carries
+// it across and floor() gives the same days and msOfDay as
+// solarSplitMillis().
+template <class M>
+SOLAR_CONSTEXPR void solarSplitMillisDouble(int64_t ms, double &days,
+                                            double &msOfDay){
+    double hi = (double)(int32_t)(ms >> 32) * 4294967296.0;
+    double lo = (double)(int32_t)((uint32_t)ms ^ 0x80000000UL) + 2147483648.0;
+    double t = hi + lo;
+    days = M::floor(t / 86400000);
+    msOfDay = t - days * 86400000;
+}
+
+// Fill in a SolarEphemerisT for utcMinutes past midnight GMT on day unixDays
+// (days since 1970-1-1).
+template <typename T, class M>
+SOLAR_CONSTEXPR void solarEphemerisAt(long unixDays, T utcMinutes,
+                                      SolarEphemerisT<T> &E){
+    E.utcMinutes = utcMinutes;
+    E.JDN = julianUnixEpoch + unixDays + (double)utcMinutes / 1440;
+    // Julian Century Number, counted from the whole days since 2000-01-01
+    // so that a float keeps its precision
+    E.JCN = ((T)(unixDays - 10957) + (utcMinutes / 1440 - T(0.5))) / 36525;
+    solarEphemerisStages<T, M>(E, SOLAR_MEAN | SOLAR_CENTER | SOLAR_OBLIQUITY |
+                                  SOLAR_DECLINATION | SOLAR_EOT);
+}
+
+// Calculate the values that stay the same for a whole day, given the
+// declination SDec and equation of time EOT at local noon of the day
+template <typename T, class M, class S>
+SOLAR_CONSTEXPR void solarDayFrom(long unixDays, const S &site, T SDec, T EOT,
+                                  SolarDayT<T> &SD){
+    const T D2R = T(DEG_TO_RAD);
+    const int tzOffset = site.tzOffset();
+    SD.unixDays = unixDays;
+    SD.tier = M::tier;
+    // Solar Noon - result is given as fraction of a day
+    // Time value is in GMT time zone
+    SD.SolarNoonfrac = (720 - T(site.lonMinutes()) - EOT) / 1440 ;
+    // SolarNoon is given as a fraction of a day. Add this
+    // to the unixDays value, which currently holds the
+    // whole days since 1970-1-1 00:00
+    SD.SolarNoonDays = SD.unixDays + (double)SD.SolarNoonfrac;
+    // SolarNoonDays is in GMT time zone, correct it to
+    // the input time zone
+    SD.SolarNoonDays = SD.SolarNoonDays + ((double)tzOffset / 24);
+    // Then convert SolarNoonDays to seconds
+    SD.SolarNoonTime = SD.SolarNoonDays * 86400;
+    // Hour Angle Sunrise (degrees)
+    SD.HAS = M::acos((T(site.cosHorizon())/
+                (T(site.cosLat()) * M::cos(SDec * D2R))) -
+               T(site.tanLat()) * M::tan(SDec * D2R)) * 
+               T(RAD_TO_DEG);
+    // Sunrise Time, given as fraction of a day
+    SD.Sunrise = SD.SolarNoonfrac - SD.HAS * 4/1440;
+    // Convert Sunrise to days since 1970-1-1
+    SD.Sunrise = SD.unixDays + SD.Sunrise;
+    // Correct Sunrise to local time zone from GMT
+    SD.Sunrise = SD.Sunrise + ((double)tzOffset / 24);
+    // Convert Sunrise to seconds since 1970-1-1
+    SD.Sunrise = SD.Sunrise * 86400;
+    // Convert Sunrise to a time_t object (Time library)
+    SD.SunriseTime = (time_t)SD.Sunrise;
+    // Sunset Time
+    SD.Sunset = SD.SolarNoonfrac + SD.HAS * 4/1440;
+    // Convert Sunset to days since 1970-1-1
+    SD.Sunset = SD.unixDays + SD.Sunset;
+    // Correct Sunset to local time zone from GMT
+    SD.Sunset = SD.Sunset + ((double)tzOffset / 24);
+    // Convert Sunset to seconds since 1970-1-1
+    SD.Sunset = SD.Sunset * 86400;
+    // Convert Sunset to a time_t object (Time library)
+    SD.SunsetTime = (time_t)SD.Sunset;
+    // Sunlight Duration (day length, minutes)
+    SD.SunDuration = 8 * SD.HAS;
+}
+
+// Calculate the values that stay the same for a whole day. The declination
+// and equation of time used are those at local noon of the requested day.
+template <typename T, class M, class S>
+SOLAR_CONSTEXPR void solarDay(long unixDays, const S &site, SolarDayT<T> &SD){
+    // Local noon, in days and minutes past midnight GMT
+    long noonMinutes = 720 - site.tzOffset() * 60L;
+    long refDays = unixDays + solarFloorDiv(noonMinutes, 1440L);
+    SolarEphemerisT<T> ref = {};
+    solarEphemerisAt<T, M>(refDays,
+                           (T)(noonMinutes - (refDays - unixDays) * 1440), ref);
+    solarDayFrom<T, M>(unixDays, site, ref.SDec, ref.EOT, SD);
+}
+
+
+// Copy the per-day values into the matching SolarElements fields
+template <typename T>
+inline void copySolarDay(const SolarDayT<T> &SD, SolarElementsT<T> &SE){
+    SE.HAS = SD.HAS;
+    SE.SolarNoonfrac = SD.SolarNoonfrac;
+    SE.SolarNoonDays = SD.SolarNoonDays;
+    SE.SolarNoonTime = SD.SolarNoonTime;
+    SE.Sunrise = SD.Sunrise;
+    SE.SunriseTime = SD.SunriseTime;
+    SE.Sunset = SD.Sunset;
+    SE.SunsetTime = SD.SunsetTime;
+    SE.SunDuration = SD.SunDuration;
+    SE.tier = SD.tier;
+}
+
+// Evaluate the requested stages of calcSolar() for a site, at timeFracDay
+// (fraction of the day past midnight) on day unixDays (whole days since the
+// start of the Unix epoch), both in the local time zone
+template <typename T, class M, class S>
+SOLAR_CONSTEXPR void solarStagesAt(long unixDays, T timeFracDay,
+                                   SolarElementsT<T> &SE, const S &site,
+                                   unsigned int stages){
+    if (stages & SOLAR_TIME) {
+        SE.unixDays = unixDays;
+        // Time past midnight, as a fractional day value
+        // e.g. if it's noon, the result should be 0.5.
+        SE.timeFracDay = timeFracDay;
+        // calculate Julian Day Number
+        SE.JDN = julianUnixEpoch + SE.unixDays;
+        // Add the fractional day value to the Julian Day number. If the
+        // input value was in the GMT time zone, we could proceed directly
+        // with this value. 
+        SE.JDN = SE.JDN + SE.timeFracDay;
+        // Adjust JDN to GMT time zone
+        SE.JDN = SE.JDN - ((double)site.tzOffset() / 24);
+        // Calculate Julian Century Number. This is the same as
+        // (JDN - 2451545) / 36525, but starts from the whole days since
+        // 2000-01-01 so that a float does not lose the time of day in the
+        // rounding of a seven digit Julian Day Number.
+        SE.JCN = ((T)(SE.unixDays - 10957) +
+                  (SE.timeFracDay - T(site.tzDays()) - T(0.5))) / 36525;
+    }
+    solarEphemerisStages<T, M>(SE, stages);
+    if (stages & (SOLAR_NOON | SOLAR_RISESET)) {
+        // Sunrise, sunset and solar noon are the same for every time value
+        // in the day, so they come from the per-day calculation
+        SolarDayT<T> SD;
+        solarDay<T, M>(SE.unixDays, site, SD);
+        copySolarDay(SD, SE);
+    }
+    if (stages & (SOLAR_HOURANGLE | SOLAR_ZENITH | SOLAR_REFRACTION |
+                  SOLAR_AZIMUTH)) {
+        // Minutes past midnight GMT
+        T utcMinutes = SE.timeFracDay * 1440 - 60 * site.tzOffset();
+        solarPositionStages<T, M>(SE, SE.SDec, SE.EOT, utcMinutes, site,
+                                  stages);
+    }
+}
+
+// Evaluate the requested stages of calcSolar() at time t for a site
+template <typename T, class M, class S>
+SOLAR_CONSTEXPR void solarStages(time_t t, SolarElementsT<T> &SE, const S &site,
+                                 unsigned int stages){
+    long days = 0, secs = 0;
+    solarSplitTime(t, days, secs);
+    solarStagesAt<T, M>(days, (T)secs / 86400, SE, site, stages);
+}
+
+#endif
@@ -0,0 +1,383 @@
+/* SolarFixed.cpp
+ * Released into the public domain (originally based on U.S. Govt. products)
+ * No warranty given or implied.
+ *
+ * Integer-only version of the solar calculator. See SolarFixed.h for usage
+ * and accuracy.
+ *
+ * Angles are binary angles: a uint32_t where 2^32 is one full circle, so
+ * adding and subtracting angles wraps around 360 degrees for free. Sines and
+ * cosines are Q30 (1.0 is 2^30). Slowly varying terms from the NOAA
+ * equations that change the result by less than 0.001 degree over
+ * 1901-2099 (the squared Julian Century terms) are left out.
+ *
+ * 64-bit division is a slow library call on an 8-bit AVR, so apart from
+ * 1/tan in the refraction, divisions by a constant are multiplies by its
+ * reciprocal or are done in 32 bits.
+ */
+#include "SolarFixed.h"
+
+#define FIXED_ONE		(1L << 30)		// 1.0 in Q30
+#define BAM_90			0x40000000UL	// 90 degrees as a binary angle
+#define BAM_180			0x80000000UL	// 180 degrees as a binary angle
+#define BAM_ROUND		0x80000000LL	// half of the 2^32 divisor, for rounding
+#define TIME_MIN		(-2147483647L - 1)	// range of a 32-bit time value
+#define TIME_MAX		2147483647L
+
+// Angles at 2000-01-01 12:00 GMT (J2000) and their rates of change. Rates are
+// binary angle units per day, and per second, times 2^16.
+#define L0		3346095204UL	// Geometric Mean Longitude of Sun, 280.46646
+#define L_RATE	770652965964LL	// 0.98564736 degrees per day
+#define M0		4265488430UL	// Geometric Mean Anomaly of Sun, 357.52911
+#define M_RATE	770616156513LL	// 0.98560028 degrees per day
+#define OMEGA0	1491785307UL	// Longitude of the Moon's node, 125.04
+#define OMEGA_RATE	-41403215876LL	// -0.0529538 degrees per day
+#define PER_SECOND(rate)	((rate) / 86400)
+// Slow changes, given per century by NOAA, are per day times 2^13 here
+#define EPS0	279641634L		// Mean Oblique Ecliptic, 23.439291
+#define EPS_T	34797L			// 0.0130042 degrees per century
+// Sun Equation of Center coefficients (binary angle)
+#define C1		22842092L		// 1.914602
+#define C1_T	12889L			// 0.004817 per century
+#define C2		238526L			// 0.019993
+#define C3		3448L			// 0.000289
+#define ABERRATION	67884L		// 0.00569
+#define NUT_LON		57028L		// 0.00478
+#define NUT_OBL		30542L		// 0.00256
+// Eccentricity of Earth Orbit, Q30
+#define EEO0	17940759L		// 0.016708634
+#define EEO_T	10124L			// 0.000042037 per century
+#define SRV_A	1073742917LL	// 1.000001018, Q30
+#define COS_SUNRISE	-15610145L	// cos(90.833 degrees), Q30
+// var y, tan(OC/2)^2, at EPS0 (Q30), and its change per binary angle unit of
+// OC (Q30, times 2^30). OC stays within 0.016 degree of EPS0 over 1901-2099, so a
+// straight line is good to 1e-8.
+#define VY0		46207973L
+#define VY_SLOPE	364944614LL
+// Binary angle units per millisecond of time of day, times 2^24
+#define BAM_PER_MS	833999931LL
+// Binary angle units per millidegree, times 2^16
+#define BAM_PER_MDEG	781874935LL
+// Milliseconds of Equation of Time per radian (4 minutes per degree)
+#define EOT_MS_PER_RAD	13750987LL
+
+// CORDIC gain correction, 0.6072529, Q30
+#define CORDIC_K	652032874L
+// atan(2^-i) as binary angles
+static const uint32_t cordicAtan[30] = {
+	536870912UL, 316933406UL, 167458907UL, 85004756UL, 42667331UL,
+	21354465UL, 10679838UL, 5340245UL, 2670163UL, 1335087UL,
+	667544UL, 333772UL, 166886UL, 83443UL, 41722UL,
+	20861UL, 10430UL, 5215UL, 2608UL, 1304UL,
+	652UL, 326UL, 163UL, 81UL, 41UL,
+	20UL, 10UL, 5UL, 3UL, 1UL
+};
+
+// Time-dependent values shared by the position and day calculations
+typedef struct {
+	uint32_t dec;		// Sun Declination (binary angle)
+	int32_t sinDec;		// Q30
+	int32_t cosDec;		// Q30
+	int32_t eotMs;		// Equation of Time (milliseconds)
+	int32_t srv;		// Sun Radius Vector (AU, Q30)
+} FixedEphemeris;
+
+// Multiply two Q30 numbers
+static int32_t mulQ30(int32_t a, int32_t b){
+	return (int32_t)(((int64_t)a * b) >> 30);
+}
+
+// Binary angle to and from millidegrees
+static int32_t bamToMdeg(uint32_t a){
+	return (int32_t)(((int64_t)(int32_t)a * 360000 + BAM_ROUND) >> 32);
+}
+static uint32_t mdegToBam(int32_t mdeg){
+	return (uint32_t)(((int64_t)mdeg * BAM_PER_MDEG) >> 16);
+}
+
+// Sine and cosine (Q30) of binary angle a, by CORDIC rotation
+static void fixedSinCos(uint32_t a, int32_t &s, int32_t &c){
+	// CORDIC only converges between -90 and +90 degrees, so rotate angles
+	// outside that half-turn and flip the result back afterwards
+	bool flip = false;
+	if ((uint32_t)(a + BAM_90) > BAM_180) {
+		a += BAM_180;
+		flip = true;
+	}
+	int32_t x = CORDIC_K;
+	int32_t y = 0;
+	uint32_t z = a;
+	for (int i = 0; i < 30; i++) {
+		int32_t dx = x >> i;
+		int32_t dy = y >> i;
+		if ((int32_t)z >= 0) {
+			x -= dy;
+			y += dx;
+			z -= cordicAtan[i];
+		} else {
+			x += dy;
+			y -= dx;
+			z += cordicAtan[i];
+		}
+	}
+	c = flip ? -x : x;
+	s = flip ? -y : y;
+}
+
+// atan2(y, x) as a binary angle, by CORDIC vectoring. x and y are Q30 with
+// magnitude up to 1.
+static uint32_t fixedAtan2(int32_t y, int32_t x){
+	// Drop two bits of headroom, since the vector grows by 1.65 during the
+	// iterations
+	x >>= 2;
+	y >>= 2;
+	uint32_t z = 0;
+	if (x < 0) {
+		x = -x;
+		y = -y;
+		z = BAM_180;
+	}
+	for (int i = 0; i < 30; i++) {
+		int32_t dx = x >> i;
+		int32_t dy = y >> i;
+		if (y > 0) {
+			x += dy;
+			y -= dx;
+			z += cordicAtan[i];
+		} else {
+			x -= dy;
+			y += dx;
+			z -= cordicAtan[i];
+		}
+	}
+	return z;
+}
+
+// Integer square root of a 64 bit number
+static uint32_t isqrt64(uint64_t n){
+	uint64_t root = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+	while (bit > n) bit >>= 2;
+	while (bit != 0) {
+		if (n >= root + bit) {
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)root;
+}
+
+// cos(asin(s)) for a Q30 sine s
+static int32_t fixedCosFromSin(int32_t s){
+	uint64_t s2 = (uint64_t)((int64_t)s * s);
+	if (s2 >= ((uint64_t)1 << 60)) return 0;	// rounding took |s| past 1
+	return (int32_t)isqrt64(((uint64_t)1 << 60) - s2);
+}
+
+// Angle that advances at rate (binary angle per day, times 2^16) from a
+// starting value at J2000. d2000 is whole days since 2000-01-01 and sod the
+// seconds past midnight GMT.
+static uint32_t fixedMeanAngle(uint32_t start, int64_t rate, int32_t d2000,
+							   int32_t sod){
+	int64_t a = (int64_t)d2000 * rate +
+				(int64_t)(sod - 43200) * PER_SECOND(rate);
+	return start + (uint32_t)(a >> 16);
+}
+
+// Split seconds since 1970-1-1 into whole days and seconds past midnight,
+// rounding the days down so times before 1970 work as well
+static void fixedSplitDays(int32_t t, int32_t &days, int32_t &sod){
+	days = t / 86400;
+	sod = t - days * 86400;
+	if (sod < 0) {
+		sod += 86400;
+		days--;
+	}
+}
+
+// Add s seconds, less than a day either way, to a day and seconds past
+// midnight. Unlike adding them to a time value, this cannot run past the
+// 32-bit range.
+static void fixedAddSeconds(int32_t &days, int32_t &sod, int32_t s){
+	sod += s;
+	if (sod < 0) {
+		sod += 86400;
+		days--;
+	} else if (sod >= 86400) {
+		sod -= 86400;
+		days++;
+	}
+}
+
+// A day's time in seconds since 1970-1-1, held to the 32-bit range. Only
+// the first and last days of the range have times of day outside it.
+static int32_t fixedDayTime(int32_t days, int32_t s){
+	int64_t t = (int64_t)days * 86400 + s;
+	if (t < TIME_MIN) return TIME_MIN;
+	if (t > TIME_MAX) return TIME_MAX;
+	return (int32_t)t;
+}
+
+// Declination, Equation of Time and Sun Radius Vector for a GMT time
+static void fixedEphemeris(int32_t days, int32_t sod, FixedEphemeris &E){
+	int32_t d2000 = days - 10957;	// days since 2000-01-01
+	// Julian centuries since J2000, only needed to 1 part in 36525
+	int32_t daysJ2000 = d2000 - (sod < 43200 ? 1 : 0);
+	uint32_t GMLS = fixedMeanAngle(L0, L_RATE, d2000, sod);
+	uint32_t GMAS = fixedMeanAngle(M0, M_RATE, d2000, sod);
+	uint32_t omega = fixedMeanAngle(OMEGA0, OMEGA_RATE, d2000, sod);
+	int32_t EEO = EEO0 - ((daysJ2000 * EEO_T) >> 13);
+	int32_t sinM, cosM, sin2M, cos2M, sin3M, cos3M;
+	fixedSinCos(GMAS, sinM, cosM);
+	fixedSinCos(2 * GMAS, sin2M, cos2M);
+	fixedSinCos(3 * GMAS, sin3M, cos3M);
+	// Sun Equation of Center
+	int32_t c1 = C1 - ((daysJ2000 * C1_T) >> 13);
+	int32_t SEC = (int32_t)(((int64_t)sinM * c1 + (int64_t)sin2M * C2 +
+							 (int64_t)sin3M * C3) >> 30);
+	uint32_t STL = GMLS + (uint32_t)SEC;	// Sun True Longitude
+	uint32_t STA = GMAS + (uint32_t)SEC;	// Sun True Anomaly
+	// Sun Radius Vector, dividing by 1 + x with x below 0.017 as a series
+	int32_t sinV, cosV;
+	fixedSinCos(STA, sinV, cosV);
+	int32_t num = (int32_t)((SRV_A * (FIXED_ONE - mulQ30(EEO, EEO))) >> 30);
+	int32_t x = mulQ30(EEO, cosV);
+	int32_t x2 = mulQ30(x, x);
+	E.srv = mulQ30(num, FIXED_ONE - x + x2 - mulQ30(x2, x) + mulQ30(x2, x2));
+	// Sun Apparent Longitude and Oblique correction
+	int32_t sinO, cosO;
+	fixedSinCos(omega, sinO, cosO);
+	uint32_t SAL = STL - ABERRATION - (uint32_t)mulQ30(sinO, NUT_LON);
+	uint32_t OC = EPS0 - ((daysJ2000 * EPS_T) >> 13) + mulQ30(cosO, NUT_OBL);
+	// Sun Declination
+	int32_t sinL, cosL, sinE, cosE;
+	fixedSinCos(SAL, sinL, cosL);
+	fixedSinCos(OC, sinE, cosE);
+	E.sinDec = mulQ30(sinE, sinL);
+	E.cosDec = fixedCosFromSin(E.sinDec);
+	E.dec = fixedAtan2(E.sinDec, E.cosDec);
+	// var y, tan(OC/2)^2
+	int32_t vy = VY0 + (int32_t)(((int64_t)(int32_t)(OC - EPS0) * VY_SLOPE) >>
+								 30);
+	// Equation of Time, in radians (Q30) and then milliseconds
+	int32_t sin2L, cos2L, sin4L, cos4L;
+	fixedSinCos(2 * GMLS, sin2L, cos2L);
+	fixedSinCos(4 * GMLS, sin4L, cos4L);
+	int64_t eot = (int64_t)mulQ30(vy, sin2L) - 2 * (int64_t)mulQ30(EEO, sinM) +
+				  4 * (int64_t)mulQ30(mulQ30(EEO, vy), mulQ30(sinM, cos2L)) -
+				  mulQ30(mulQ30(vy, vy), sin4L) / 2 -
+				  (5 * (int64_t)mulQ30(mulQ30(EEO, EEO), sin2M)) / 4;
+	E.eotMs = (int32_t)((eot * EOT_MS_PER_RAD) >> 30);
+}
+
+// Refraction in millidegrees for an elevation h (binary angle)
+static int32_t fixedRefraction(uint32_t h){
+	int32_t mdeg = bamToMdeg(h);
+	int32_t mas;	// milliarcseconds
+	if (mdeg > 85000) {
+		return 0;
+	} else if (mdeg > 5000 || mdeg <= -575) {
+		// Both of these use 1/tan(h), as Q16
+		int32_t s, c;
+		fixedSinCos(h, s, c);
+		int64_t u = ((int64_t)c << 16) / s;
+		if (mdeg > 5000) {
+			int64_t u2 = (u * u) >> 16;
+			int64_t u3 = (u2 * u) >> 16;
+			int64_t u5 = (u3 * u2) >> 16;
+			// 0.086 is 5636 / 2^16
+			mas = (int32_t)((58100 * u - 70 * u3 + ((u5 * 5636) >> 16)) >> 16);
+		} else {
+			mas = (int32_t)((-20772 * u) >> 16);
+		}
+	} else {
+		// 1735 - 581.2h + 103.4h^2 - 12.79h^3 + 0.711h^4, h in degrees,
+		// worked in milli-units, which stay within 32 bits here
+		int32_t acc = 711;
+		acc = -12790 + (acc * mdeg) / 1000;
+		acc = 103400 + (acc * mdeg) / 1000;
+		acc = -581200 + (acc * mdeg) / 1000;
+		mas = 1735000 + (acc * mdeg) / 1000;
+	}
+	return mas / 3600;
+}
+
+void initSolarFixedSite(SolarFixedSite &site, int tzOffset, int32_t lat,
+						int32_t lon){
+	site.tzOffset = tzOffset;
+	site.lat = lat;
+	site.lon = lon;
+	fixedSinCos(mdegToBam(lat), site.sinLat, site.cosLat);
+}
+
+void calcSolarFixed(int32_t t, const SolarFixedSite &site,
+					SolarFixedPosition &P){
+	int32_t days, sod;
+	fixedSplitDays(t, days, sod);
+	fixedAddSeconds(days, sod, -site.tzOffset * 3600L);
+	FixedEphemeris E;
+	fixedEphemeris(days, sod, E);
+	P.SDec = bamToMdeg(E.dec);
+	P.EOT = E.eotMs;
+	P.SRV = E.srv;
+	// Hour Angle: true solar time as a fraction of a day is the angle past
+	// midnight, 4 minutes (240000 ms) per degree of longitude
+	int32_t tstMs = sod * 1000L + E.eotMs + site.lon * 240L;
+	uint32_t HA = (uint32_t)(((int64_t)tstMs * BAM_PER_MS) >> 24) + BAM_180;
+	P.HA = bamToMdeg(HA);
+	int32_t sinH, cosH;
+	fixedSinCos(HA, sinH, cosH);
+	// Solar Elevation, from the cosine of the zenith angle
+	int32_t cosZ = mulQ30(site.sinLat, E.sinDec) +
+				   mulQ30(mulQ30(site.cosLat, E.cosDec), cosH);
+	uint32_t SEA = fixedAtan2(cosZ, fixedCosFromSin(cosZ));
+	P.SEA = bamToMdeg(SEA);
+	P.AAR = fixedRefraction(SEA);
+	P.SEC_Corr = P.SEA + P.AAR;
+	// Solar Azimuth, measured from south then turned to clockwise from north
+	int32_t ay = mulQ30(sinH, E.cosDec);
+	int32_t ax = mulQ30(mulQ30(cosH, site.sinLat), E.cosDec) -
+				 mulQ30(E.sinDec, site.cosLat);
+	uint32_t SAA = fixedAtan2(ay, ax) + BAM_180;
+	P.SAA = (int32_t)(((int64_t)SAA * 360000 + BAM_ROUND) >> 32);
+	if (P.SAA >= 360000) P.SAA -= 360000;
+}
+
+void calcSolarFixedDay(int32_t t, const SolarFixedSite &site,
+					   SolarFixedDay &D){
+	int32_t days, sod;
+	fixedSplitDays(t, days, sod);
+	// Ephemeris at local noon of the day, as in calcSolarDay()
+	int32_t refDays = days, refSod = 43200;
+	fixedAddSeconds(refDays, refSod, -site.tzOffset * 3600L);
+	FixedEphemeris E;
+	fixedEphemeris(refDays, refSod, E);
+	// Hour Angle Sunrise: cos(HAS) = num / den, where num is
+	// cos(90.833) - sin(lat)sin(dec) and den is cos(lat)cos(dec). atan2()
+	// takes the sine and cosine scaled alike, so it is worked out from num
+	// and sqrt(den^2 - num^2) without dividing.
+	int32_t num = COS_SUNRISE - mulQ30(site.sinLat, E.sinDec);
+	int32_t den = mulQ30(site.cosLat, E.cosDec);
+	uint32_t HAS;
+	if (num >= den) {
+		HAS = 0;			// polar night
+	} else if (num <= -den) {
+		HAS = BAM_180;		// polar day
+	} else {
+		uint64_t s2 = (uint64_t)((int64_t)den * den - (int64_t)num * num);
+		HAS = fixedAtan2((int32_t)isqrt64(s2), num);
+	}
+	D.HAS = (int32_t)(((int64_t)HAS * 360000 + BAM_ROUND) >> 32);
+	// Solar noon, sunrise and sunset in milliseconds past local midnight.
+	// All are within a day or so of it, so 32 bits are enough.
+	int32_t noonMs = 43200000L - site.lon * 240L - E.eotMs +
+					 site.tzOffset * 3600000L;
+	int32_t hasMs = (int32_t)(((int64_t)HAS * 86400000) >> 32);
+	D.SolarNoonTime = fixedDayTime(days, noonMs / 1000);
+	D.SunriseTime = fixedDayTime(days, (noonMs - hasMs) / 1000);
+	D.SunsetTime = fixedDayTime(days, (noonMs + hasMs) / 1000);
+	D.SunDuration = 2 * hasMs / 1000;
+}
@@ -0,0 +1,87 @@
+/* SolarFixed.h
+ * Released into the public domain (originally based on U.S. Govt. products)
+ * No warranty given or implied.
+ *
+ * Integer-only version of the solar calculator, for boards without a
+ * floating point unit (8-bit AVR such as the Uno, Cortex-M0). It follows
+ * the same NOAA equations as calcSolar() in Solarlib.h, but keeps angles as
+ * 32-bit binary angles (the full circle is 2^32) and sines and cosines as
+ * Q30 fixed point numbers (1.0 is 2^30). Trig functions are done with CORDIC
+ * shift-and-add iterations, so no floating point code is pulled in at all.
+ *
+ * Results are given in whole units that fit a long:
+ * 		angles		- millidegrees (1/1000 of a degree)
+ * 		times		- seconds since 1970-1-1, local time zone
+ * 		EOT			- milliseconds
+ *
+ * Set up a site with initSolarFixedSite(), then call calcSolarFixed() for
+ * the sun position and calcSolarFixedDay() for sunrise, noon and sunset:
+ *
+ * 		SolarFixedSite site;
+ * 		initSolarFixedSite(site, -8, 36620, -121904); // Monterey, California
+ * 		SolarFixedPosition pos;
+ * 		calcSolarFixed(t, site, pos);
+ * 		// pos.SEC_Corr is elevation, pos.SAA is azimuth, in millidegrees
+ *
+ * Accuracy, compared with the double precision calcSolar() over 1901 to 2038
+ * at latitudes up to +/- 71.5 degrees (see extras/fixed/README.md):
+ * 		elevation				- within 0.001 degree
+ * 		azimuth					- within 0.004 degree while the sun is up
+ * 		sunrise and sunset		- within 4 seconds
+ * This is well inside the roughly 0.01 degree accuracy of the NOAA equations
+ * themselves. Corrected elevation agrees as closely, except within a
+ * millidegree of 5 degrees elevation, where the refraction formula has a
+ * 0.088 degree step. The time value is a 32-bit count of seconds, so the
+ * usable range is 1901 to 2038. On the first and last days of that range,
+ * sunrise, noon and sunset times that fall outside it are given as its ends.
+ */
+#ifndef SolarFixed_h
+#define SolarFixed_h
+
+#include <stdint.h>
+
+// Site parameters, with the latitude sine and cosine worked out in advance
+typedef struct {
+	int tzOffset;	// Time zone Offset, zones west of GMT are negative
+	int32_t lat;	// Latitude of site (millidegrees), north is positive
+	int32_t lon;	// Longitude of site (millidegrees), west is negative
+	int32_t sinLat;	// sin(lat), Q30
+	int32_t cosLat;	// cos(lat), Q30
+} SolarFixedSite;
+
+// Sun position at one instant
+typedef struct {
+	int32_t SDec;		// Sun Declination (millidegrees)
+	int32_t EOT;		// Equation of Time (milliseconds)
+	int32_t SRV;		// Sun Radius Vector (Astronomical Units, Q30)
+	int32_t HA;			// Hour Angle (millidegrees)
+	int32_t SEA;		// Solar Elevation Angle (millidegrees)
+	int32_t AAR;		// Approximate Atmospheric Refraction (millidegrees)
+	int32_t SEC_Corr;	// Solar Elevation, Corrected (millidegrees)
+	int32_t SAA;		// Solar Azimuth Angle (millidegrees clockwise from North)
+} SolarFixedPosition;
+
+// Values for a whole day. As with calcSolarDay(), these use the declination
+// and equation of time at local noon. When the sun does not rise (polar
+// night) HAS is 0; when it does not set (polar day) HAS is 180 degrees.
+typedef struct {
+	int32_t HAS;			// Hour Angle Sunrise (millidegrees)
+	int32_t SolarNoonTime;	// Solar Noon (seconds since 1970-1-1, local)
+	int32_t SunriseTime;	// Sunrise (seconds since 1970-1-1, local)
+	int32_t SunsetTime;		// Sunset (seconds since 1970-1-1, local)
+	int32_t SunDuration;	// Sunlight Duration (seconds)
+} SolarFixedDay;
+
+// Fill in a SolarFixedSite. lat and lon are in millidegrees, e.g. 36620 for
+// 36.62 degrees north.
+void initSolarFixedSite(SolarFixedSite &site, int tzOffset, int32_t lat,
+						int32_t lon);
+// Calculate the sun position at time t (seconds since 1970-1-1, local time
+// zone, as for calcSolar())
+void calcSolarFixed(int32_t t, const SolarFixedSite &site,
+					SolarFixedPosition &P);
+// Calculate sunrise, solar noon and sunset for the day containing time t
+void calcSolarFixedDay(int32_t t, const SolarFixedSite &site,
+					   SolarFixedDay &D);
+
+#endif
@@ -0,0 +1,489 @@
+/* SolarKernel.cpp
+ * Released into the public domain (originally based on U.S. Govt. products)
+ * No warranty given or implied.
+ *
+ * Block kernel for calcSolarBatch(), see SolarKernel.h. The equations are
+ * the same as those in SolarEngine.h, rearranged so that each step is a
+ * branch-free loop over a block of time values:
+ * 		- sines and cosines of the same angle come from one sincos() call,
+ * 		  and sin(2x), sin(3x) and sin(4x) from the identities
+ * 		- the hour angle is TST/4 - 180, with the true solar time first
+ * 		  wrapped into [0, 1440) minutes by floor(), so there is no
+ * 		  if/else and nothing to select
+ * 		- refraction and azimuth use the engine's own branch-free
+ * 		  solarRefraction() and solarAzimuth()
+ *
+ * With GCC on x86 the kernel is compiled several times, for AVX-512, AVX2
+ * and SSE4.2, and the best one the processor supports is picked when the
+ * program first calls it. One binary then runs at full speed on old and new
+ * machines alike. getSolarKernel() reports which one is in use.
+ */
+#include <string.h>
+#include "SolarKernel.h"
+
+#if defined(SOLAR_HAS_KERNEL)
+
+// The kernel is only worth having vectorized, and GCC at -O2 (the Arduino
+// IDE and most builds) only vectorizes loops its cheapest cost model
+// accepts, which leaves these scalar and slower than the engine. Build the
+// rest of this file, including the engine templates it instantiates, as at
+// -O3 whatever the command line says.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("O3", "tree-vectorize")
+#endif
+
+#include "SolarEngine.h"
+#include "SolarMath.h"
+
+#if defined(__GNUC__)
+#define SOLAR_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define SOLAR_ALWAYS_INLINE inline
+#endif
+
+// Elevation, refraction and azimuth for one site and time, from the sine
+// and cosine of the hour angle, those of the declination, and those of the
+// latitude
+static SOLAR_ALWAYS_INLINE void kernelSky(double sinHA, double cosHA,
+                                          double sD, double cD, double sinLat,
+                                          double cosLat, double &sza,
+                                          double &sea, double &aar,
+                                          double &sec, double &saa){
+    typedef SolarVecMath V;
+    const double D2R = DEG_TO_RAD;
+    const double R2D = RAD_TO_DEG;
+    // Solar Zenith and Elevation Angle (degrees)
+    double SZA = V::acos(sinLat * sD + cosLat * cD * cosHA) * R2D;
+    double SEA = 90 - SZA;
+    // Approximate Atmospheric Refraction (degrees)
+    double sE, cE;
+    V::sincos(SEA * D2R, sE, cE);
+    double AAR = solarRefraction<double, V>(SEA, cE / sE) / 3600;
+    sza = SZA;
+    sea = SEA;
+    aar = AAR;
+    sec = SEA + AAR;
+    // Solar Azimuth Angle (degrees clockwise from North)
+    saa = solarAzimuth<double, V>(sinHA, cosHA, sD, cD, sinLat, cosLat);
+}
+
+// Hour Angle (degrees) from the true solar time before wrapping (minutes
+// past midnight GMT plus the equation of time and the longitude offset)
+static SOLAR_ALWAYS_INLINE double kernelHourAngle(double TST){
+    typedef SolarVecMath V;
+    TST = TST - 1440 * V::floor(TST / 1440);
+    return TST / 4 - 180;
+}
+
+// Hour angle, elevation, refraction and azimuth for one site and time, from
+// the true solar time before wrapping, the sine and cosine of the
+// declination, and those of the latitude
+static SOLAR_ALWAYS_INLINE void kernelPosition(double TST, double sD, double cD,
+                                               double sinLat, double cosLat,
+                                               double &ha, double &sza,
+                                               double &sea, double &aar,
+                                               double &sec, double &saa){
+    double HA = kernelHourAngle(TST);
+    double sH, cH;
+    SolarVecMath::sincos(HA * DEG_TO_RAD, sH, cH);
+    kernelSky(sH, cH, sD, cD, sinLat, cosLat, sza, sea, aar, sec, saa);
+    ha = HA;
+}
+
+// The kernel itself. It is inlined into one wrapper per instruction set
+// below, so the compiler vectorizes a separate copy for each.
+static SOLAR_ALWAYS_INLINE void kernelBody(const int64_t *t, size_t n,
+                                           const SolarSite &site,
+                                           const SolarChebyshev *fit,
+                                           const SolarBatchOut &out){
+    typedef SolarVecMath V;
+    const double D2R = DEG_TO_RAD;
+    const double R2D = RAD_TO_DEG;
+    const double sinLat = site.sinLat();
+    const double cosLat = site.cosLat();
+    const double lonMinutes = site.lonMinutes();
+    const double tzDays = site.tzDays();
+    const double tzMinutes = 60 * site.tzOffset();
+    const int64_t tzMillis = site.tz * 3600000LL;
+    const bool position = out.HA || out.SZA || out.SEA || out.AAR ||
+                          out.SEC_Corr || out.SAA;
+    // One array per intermediate value, for a block of time values
+    double jcn[SOLAR_BLOCK], utc[SOLAR_BLOCK], sdec[SOLAR_BLOCK];
+    double eot[SOLAR_BLOCK], ha[SOLAR_BLOCK], sza[SOLAR_BLOCK];
+    double sea[SOLAR_BLOCK], aar[SOLAR_BLOCK], sec[SOLAR_BLOCK];
+    double saa[SOLAR_BLOCK];
+    // The ephemeris from the fit, and which times it covers
+    double fitSdec[SOLAR_BLOCK], fitEot[SOLAR_BLOCK];
+    bool fitted[SOLAR_BLOCK];
+
+    for (size_t i0 = 0; i0 < n; i0 += SOLAR_BLOCK) {
+        int m = (n - i0 < SOLAR_BLOCK) ? (int)(n - i0) : SOLAR_BLOCK;
+        // Julian Century Number and minutes past midnight GMT
+        for (int l = 0; l < m; l++) {
+            double days = 0, msOfDay = 0;
+            solarSplitMillisDouble<V>(t[i0 + l], days, msOfDay);
+            double frac = msOfDay / 86400000;
+            jcn[l] = ((days - 10957) + (frac - tzDays - 0.5)) / 36525;
+            utc[l] = frac * 1440 - tzMinutes;
+        }
+        // Declination and equation of time from the fit for the times it
+        // covers, as the scalar engine does them
+        int covered = 0;
+        if (fit) {
+            for (int l = 0; l < m; l++) {
+                SolarEphemeris E;
+                fitted[l] = fit->eval(t[i0 + l] - tzMillis, E);
+                if (fitted[l]) {
+                    fitSdec[l] = E.SDec;
+                    fitEot[l] = E.EOT;
+                    covered++;
+                }
+            }
+        }
+        // and worked out in full for the rest, if any
+        if (covered < m) for (int l = 0; l < m; l++) {
+            double J = jcn[l];
+            // Geometric Mean Longitude and Anomaly of Sun (degrees)
+            double GMLS = 280.46646 + J * (36000.76983 + J * 0.0003032);
+            GMLS = GMLS - 360 * V::floor(GMLS / 360);
+            double GMAS = 357.52911 + J * (35999.05029 - 0.0001537 * J);
+            // Eccentricity of Earth Orbit
+            double EEO = 0.016708634 - J * (0.000042037 + 0.0000001267 * J);
+            double sM, cM;
+            V::sincos(GMAS * D2R, sM, cM);
+            double s2M = 2 * sM * cM;
+            double s3M = sM * (3 - 4 * sM * sM);
+            // Sun Equation of Center, True and Apparent Longitude
+            double SEC = sM * (1.914602 - J * (0.004817 + 0.000014 * J)) +
+                         s2M * (0.019993 - 0.000101 * J) + s3M * 0.000289;
+            double STL = GMLS + SEC;
+            double sOm, cOm;
+            V::sincos((125.04 - 1934.136 * J) * D2R, sOm, cOm);
+            double SAL = STL - 0.00569 - 0.00478 * sOm;
+            // Mean Oblique Ecliptic and Oblique correction (degrees)
+            double MOE = 23 + (26 + (21.448 - J * (46.815 + J *
+                               (0.00059 - J * 0.001813))) / 60) / 60;
+            double OC = MOE + 0.00256 * cOm;
+            // Sun Declination (degrees)
+            sdec[l] = V::asin(V::sin(OC * D2R) * V::sin(SAL * D2R)) * R2D;
+            // Equation of Time (minutes)
+            double vy = V::tan((OC / 2) * D2R);
+            vy = vy * vy;
+            double s2L, c2L;
+            V::sincos(2 * (GMLS * D2R), s2L, c2L);
+            double s4L = 2 * s2L * c2L;
+            eot[l] = 4 * ((vy * s2L - 2 * EEO * sM +
+                           4 * EEO * vy * sM * c2L -
+                           0.5 * vy * vy * s4L -
+                           1.25 * EEO * EEO * s2M) * R2D);
+        }
+        if (covered) for (int l = 0; l < m; l++) {
+            if (fitted[l]) {
+                sdec[l] = fitSdec[l];
+                eot[l] = fitEot[l];
+            }
+        }
+        // Hour angle, elevation, refraction and azimuth
+        if (position) {
+            for (int l = 0; l < m; l++) {
+                double sD, cD;
+                V::sincos(sdec[l] * D2R, sD, cD);
+                kernelPosition(utc[l] + eot[l] + lonMinutes, sD, cD, sinLat,
+                               cosLat, ha[l], sza[l], sea[l], aar[l], sec[l],
+                               saa[l]);
+            }
+        }
+        // Copy out the requested columns
+        if (out.SDec) for (int l = 0; l < m; l++) out.SDec[i0 + l] = sdec[l];
+        if (out.EOT) for (int l = 0; l < m; l++) out.EOT[i0 + l] = eot[l];
+        if (out.HA) for (int l = 0; l < m; l++) out.HA[i0 + l] = ha[l];
+        if (out.SZA) for (int l = 0; l < m; l++) out.SZA[i0 + l] = sza[l];
+        if (out.SEA) for (int l = 0; l < m; l++) out.SEA[i0 + l] = sea[l];
+        if (out.AAR) for (int l = 0; l < m; l++) out.AAR[i0 + l] = aar[l];
+        if (out.SEC_Corr) {
+            for (int l = 0; l < m; l++) out.SEC_Corr[i0 + l] = sec[l];
+        }
+        if (out.SAA) for (int l = 0; l < m; l++) out.SAA[i0 + l] = saa[l];
+    }
+}
+
+
+// The fleet kernel: one time value, given as its ephemeris, for n sites
+// whose latitude sines and cosines and longitude offsets are in arrays
+static SOLAR_ALWAYS_INLINE void fleetBody(const SolarEphemeris &E,
+                                          const double *sinLat,
+                                          const double *cosLat,
+                                          const double *lonMinutes, size_t n,
+                                          const SolarBatchOut &out){
+    const double base = E.utcMinutes + E.EOT;
+    double sD, cD;
+    SolarVecMath::sincos(E.SDec * DEG_TO_RAD, sD, cD);
+    double ha[SOLAR_BLOCK], sza[SOLAR_BLOCK], sea[SOLAR_BLOCK];
+    double aar[SOLAR_BLOCK], sec[SOLAR_BLOCK], saa[SOLAR_BLOCK];
+
+    for (size_t i0 = 0; i0 < n; i0 += SOLAR_BLOCK) {
+        int m = (n - i0 < SOLAR_BLOCK) ? (int)(n - i0) : SOLAR_BLOCK;
+        const double *sL = sinLat + i0;
+        const double *cL = cosLat + i0;
+        const double *lm = lonMinutes + i0;
+        for (int l = 0; l < m; l++) {
+            kernelPosition(base + lm[l], sD, cD, sL[l], cL[l], ha[l], sza[l],
+                           sea[l], aar[l], sec[l], saa[l]);
+        }
+        if (out.SDec) for (int l = 0; l < m; l++) out.SDec[i0 + l] = E.SDec;
+        if (out.EOT) for (int l = 0; l < m; l++) out.EOT[i0 + l] = E.EOT;
+        if (out.HA) for (int l = 0; l < m; l++) out.HA[i0 + l] = ha[l];
+        if (out.SZA) for (int l = 0; l < m; l++) out.SZA[i0 + l] = sza[l];
+        if (out.SEA) for (int l = 0; l < m; l++) out.SEA[i0 + l] = sea[l];
+        if (out.AAR) for (int l = 0; l < m; l++) out.AAR[i0 + l] = aar[l];
+        if (out.SEC_Corr) {
+            for (int l = 0; l < m; l++) out.SEC_Corr[i0 + l] = sec[l];
+        }
+        if (out.SAA) for (int l = 0; l < m; l++) out.SAA[i0 + l] = saa[l];
+    }
+}
+
+// Copy m values to dst, or set m values of dst to v
+static SOLAR_ALWAYS_INLINE void kernelCopy(double *dst, const double *src,
+                                           int m){
+    for (int l = 0; l < m; l++) dst[l] = src[l];
+}
+static SOLAR_ALWAYS_INLINE void kernelFill(double *dst, double v, int m){
+    for (int l = 0; l < m; l++) dst[l] = v;
+}
+
+// The raster kernel: one time value, given as its ephemeris, over rows
+// row0 to row1 - 1 of a latitude/longitude grid. The grid is worked through in tiles of
+// SOLAR_TILE_ROWS rows by SOLAR_TILE_COLS columns so the per-column values
+// stay in cache. The latitude trig is done once per row, the hour angle
+// and its sine and cosine once per column in each band of rows.
+static SOLAR_ALWAYS_INLINE void rasterBody(const SolarEphemeris &E,
+                                           const SolarGrid &grid, size_t row0,
+                                           size_t row1,
+                                           const SolarBatchOut &out,
+                                           uint8_t *daylight){
+    typedef SolarVecMath V;
+    const double base = E.utcMinutes + E.EOT;
+    double sD, cD;
+    V::sincos(E.SDec * DEG_TO_RAD, sD, cD);
+    double rowSin[SOLAR_TILE_ROWS], rowCos[SOLAR_TILE_ROWS];
+    double colHA[SOLAR_TILE_COLS], colSin[SOLAR_TILE_COLS];
+    double colCos[SOLAR_TILE_COLS];
+    double sza[SOLAR_TILE_COLS], sea[SOLAR_TILE_COLS], aar[SOLAR_TILE_COLS];
+    double sec[SOLAR_TILE_COLS], saa[SOLAR_TILE_COLS];
+
+    for (size_t r0 = row0; r0 < row1; r0 += SOLAR_TILE_ROWS) {
+        int mr = (row1 - r0 < SOLAR_TILE_ROWS) ? (int)(row1 - r0)
+                                                : SOLAR_TILE_ROWS;
+        for (int r = 0; r < mr; r++) {
+            double lat = grid.lat0 + (double)(r0 + r) * grid.dLat;
+            V::sincos(lat * DEG_TO_RAD, rowSin[r], rowCos[r]);
+        }
+        for (size_t c0 = 0; c0 < grid.cols; c0 += SOLAR_TILE_COLS) {
+            int mc = (grid.cols - c0 < SOLAR_TILE_COLS) ? (int)(grid.cols - c0)
+                                                         : SOLAR_TILE_COLS;
+            for (int c = 0; c < mc; c++) {
+                double lon = grid.lon0 + (double)(c0 + c) * grid.dLon;
+                colHA[c] = kernelHourAngle(base + 4 * lon);
+                V::sincos(colHA[c] * DEG_TO_RAD, colSin[c], colCos[c]);
+            }
+            for (int r = 0; r < mr; r++) {
+                const double sL = rowSin[r];
+                const double cL = rowCos[r];
+                for (int c = 0; c < mc; c++) {
+                    kernelSky(colSin[c], colCos[c], sD, cD, sL, cL, sza[c],
+                              sea[c], aar[c], sec[c], saa[c]);
+                }
+                // Copy out the requested columns of this row of the tile
+                size_t i0 = (r0 + r) * grid.cols + c0;
+                if (out.SDec) kernelFill(out.SDec + i0, E.SDec, mc);
+                if (out.EOT) kernelFill(out.EOT + i0, E.EOT, mc);
+                if (out.HA) kernelCopy(out.HA + i0, colHA, mc);
+                if (out.SZA) kernelCopy(out.SZA + i0, sza, mc);
+                if (out.SEA) kernelCopy(out.SEA + i0, sea, mc);
+                if (out.AAR) kernelCopy(out.AAR + i0, aar, mc);
+                if (out.SEC_Corr) kernelCopy(out.SEC_Corr + i0, sec, mc);
+                if (out.SAA) kernelCopy(out.SAA + i0, saa, mc);
+                if (daylight) {
+                    for (int c = 0; c < mc; c++) {
+                        daylight[i0 + c] = sea[c] > SOLAR_HORIZON;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// One copy of each kernel per instruction set. target() lets the compiler
+// use those instructions in this function alone; the rest of the program is
+// still built for the baseline target.
+#define SOLAR_KERNEL_VARIANT(name, attr) \
+    attr static void name##Positions(const int64_t *t, size_t n, \
+                                     const SolarSite &site, \
+                                     const SolarChebyshev *fit, \
+                                     const SolarBatchOut &out){ \
+        kernelBody(t, n, site, fit, out); \
+    } \
+    attr static void name##Fleet(const SolarEphemeris &E, \
+                                 const double *sinLat, const double *cosLat, \
+                                 const double *lonMinutes, size_t n, \
+                                 const SolarBatchOut &out){ \
+        fleetBody(E, sinLat, cosLat, lonMinutes, n, out); \
+    } \
+    attr static void name##Raster(const SolarEphemeris &E, \
+                                  const SolarGrid &grid, size_t row0, \
+                                  size_t row1, const SolarBatchOut &out, \
+                                  uint8_t *daylight){ \
+        rasterBody(E, grid, row0, row1, out, daylight); \
+    }
+
+#if defined(SOLAR_KERNEL_DISPATCH)
+SOLAR_KERNEL_VARIANT(kernelAvx512, __attribute__((target(
+    "avx512f,avx512dq,avx512vl,avx512bw,avx2,fma,bmi2"))))
+SOLAR_KERNEL_VARIANT(kernelAvx2, __attribute__((target("avx2,fma,bmi2"))))
+SOLAR_KERNEL_VARIANT(kernelSse42, __attribute__((target("sse4.2,popcnt"))))
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+// Built for whatever the compiler targets. Only x86 has been measured to
+// vectorize the selects, so on other processors there is no native kernel
+// to name, and calcSolarBatch() reports and runs the scalar engine.
+SOLAR_KERNEL_VARIANT(kernelNative, )
+#endif
+
+struct SolarKernelVariant {
+    const char *name;
+    void (*positions)(const int64_t *, size_t, const SolarSite &,
+                      const SolarChebyshev *, const SolarBatchOut &);
+    void (*fleet)(const SolarEphemeris &, const double *, const double *,
+                  const double *, size_t, const SolarBatchOut &);
+    void (*raster)(const SolarEphemeris &, const SolarGrid &, size_t, size_t,
+                   const SolarBatchOut &, uint8_t *);
+};
+
+// Kernel variants, best first. The last is no kernel at all: the callers
+// then run the scalar engine.
+enum { KERNEL_AVX512, KERNEL_AVX2, KERNEL_SSE42, KERNEL_NATIVE, KERNEL_SCALAR,
+       KERNEL_COUNT };
+static const SolarKernelVariant kernels[KERNEL_COUNT] = {
+#if defined(SOLAR_KERNEL_DISPATCH)
+    { "avx512", kernelAvx512Positions, kernelAvx512Fleet,
+      kernelAvx512Raster },
+    { "avx2", kernelAvx2Positions, kernelAvx2Fleet,
+      kernelAvx2Raster },
+    { "sse4.2", kernelSse42Positions, kernelSse42Fleet,
+      kernelSse42Raster },
+#else
+    { "avx512", 0, 0, 0 },
+    { "avx2", 0, 0, 0 },
+    { "sse4.2", 0, 0, 0 },
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    { "native", kernelNativePositions, kernelNativeFleet,
+      kernelNativeRaster },
+#else
+    { "native", 0, 0, 0 },
+#endif
+    { "scalar", 0, 0, 0 }
+};
+
+// Whether variant k can run on this machine
+static bool kernelSupported(int k){
+#if defined(SOLAR_KERNEL_DISPATCH)
+    __builtin_cpu_init();
+    if (k == KERNEL_AVX512) {
+        return __builtin_cpu_supports("avx512f") &&
+               __builtin_cpu_supports("avx512dq") &&
+               __builtin_cpu_supports("avx512vl") &&
+               __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("avx2") &&
+               __builtin_cpu_supports("fma") &&
+               __builtin_cpu_supports("bmi2");
+    }
+    if (k == KERNEL_AVX2) {
+        return __builtin_cpu_supports("avx2") &&
+               __builtin_cpu_supports("fma") &&
+               __builtin_cpu_supports("bmi2");
+    }
+    if (k == KERNEL_SSE42) {
+        return __builtin_cpu_supports("sse4.2") &&
+               __builtin_cpu_supports("popcnt");
+    }
+#endif
+#if defined(SOLAR_USE_KERNEL)
+    // Compiled for a target the kernel vectorizes on
+    if (k == KERNEL_NATIVE) return true;
+#endif
+    return k == KERNEL_SCALAR;
+}
+
+// The best variant this machine can run
+static int kernelBest(){
+    int k = 0;
+    while (!kernelSupported(k)) k++;
+    return k;
+}
+
+// The variant in use, chosen the first time it is needed. A function-local
+// static so that it is set up safely even when first used from another
+// file's static constructors or from several threads at once.
+static int &kernelChoice(){
+    static int k = kernelBest();
+    return k;
+}
+
+bool solarKernelPositions(const int64_t *t, size_t n, const SolarSite &site,
+                          const SolarBatchOut &out, const SolarChebyshev *fit){
+    const SolarKernelVariant &k = kernels[kernelChoice()];
+    if (!k.positions) return false;
+    k.positions(t, n, site, fit, out);
+    return true;
+}
+
+bool solarKernelFleet(const SolarEphemeris &E, const double *sinLat,
+                      const double *cosLat, const double *lonMinutes,
+                      size_t n, const SolarBatchOut &out){
+    const SolarKernelVariant &k = kernels[kernelChoice()];
+    if (!k.fleet) return false;
+    k.fleet(E, sinLat, cosLat, lonMinutes, n, out);
+    return true;
+}
+
+bool solarKernelRaster(const SolarEphemeris &E, const SolarGrid &grid,
+                       size_t row0, size_t row1, const SolarBatchOut &out,
+                       uint8_t *daylight){
+    const SolarKernelVariant &k = kernels[kernelChoice()];
+    if (!k.raster) return false;
+    k.raster(E, grid, row0, row1, out, daylight);
+    return true;
+}
+
+const char *getSolarKernel(){
+    return kernels[kernelChoice()].name;
+}
+
+bool setSolarKernel(const char *name){
+    if (!name) {
+        kernelChoice() = kernelBest();
+        return true;
+    }
+    for (int k = 0; k < KERNEL_COUNT; k++) {
+        if (strcmp(name, kernels[k].name) == 0 && kernelSupported(k)) {
+            kernelChoice() = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+#else
+
+// No kernel on this target; calcSolarBatch() always runs the scalar engine
+const char *getSolarKernel(){
+    return "scalar";
+}
+
+bool setSolarKernel(const char *name){
+    return !name || strcmp(name, "scalar") == 0;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/* SolarKernel.h
+ * Released into the public domain (originally based on U.S. Govt. products)
+ * No warranty given or implied.
+ *
+ * Batch kernel behind calcSolarBatch(). Time values are handled in blocks,
+ * one array per intermediate value, and each step of the calculation is a
+ * loop over the block with no branches or library calls (see SolarVecMath in
+ * SolarMath.h). Built with optimization (-O3 for GCC), the compiler turns
+ * those loops into SSE, AVX2 or AVX-512 code for as many time values per
+ * instruction as the target allows. calcSolar() is the reference the kernel
+ * is checked against; see extras/kernel/README.md.
+ *
+ * The kernel is left out on AVR, where double is the same as float and
+ * there is no vector unit; calcSolarBatch() uses the scalar engine there,
+ * and on other targets the compiler cannot vectorize the kernel for.
+ */
+#ifndef SolarKernel_h
+#define SolarKernel_h
+
+#include "Solarlib.h"
+
+// Time values handled per block. The sizes are also the units work is
+// split into for threads, so they are defined even without the kernel.
+#define SOLAR_BLOCK 64
+// Rows and columns per tile of a raster
+#define SOLAR_TILE_ROWS 32
+#define SOLAR_TILE_COLS 256
+
+#if !defined(__AVR__)
+#define SOLAR_HAS_KERNEL
+
+// The kernel only beats the scalar engine when its loops are vectorized.
+// The selects need 64-bit integer compares, which x86 has from SSE4.2 on.
+// With GCC on x86 a copy is built for each instruction set and the best one
+// chosen at run time; otherwise the kernel is used when the compiler targets
+// SSE4.2 or later (for example -march=x86-64-v2, -mavx2 or -march=native).
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SOLAR_KERNEL_DISPATCH
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE4_2__)
+#define SOLAR_USE_KERNEL
+#endif
+
+// Fill the SDec, EOT, HA, SZA, SEA, AAR, SEC_Corr and SAA columns of out
+// that are not null, for n times in milliseconds since 1970-1-1 (local time
+// zone) at a prepared site, with the declination and equation of time from
+// fit for the times it covers. Returns false, writing nothing, when no
+// vectorized kernel can run on this machine.
+bool solarKernelPositions(const int64_t *t, size_t n, const SolarSite &site,
+                          const SolarBatchOut &out,
+                          const SolarChebyshev *fit = 0);
+// Fill the HA, SZA, SEA, AAR, SEC_Corr and SAA columns of out that are not
+// null for n sites at one instant, given its ephemeris and the sites'
+// latitude sines and cosines and longitude offsets (4 * lon, minutes). The
+// SDec and EOT columns, if given, get the ephemeris values. Returns false,
+// writing nothing, when no vectorized kernel can run on this machine.
+bool solarKernelFleet(const SolarEphemeris &E, const double *sinLat,
+                      const double *cosLat, const double *lonMinutes,
+                      size_t n, const SolarBatchOut &out);
+// Fill the columns of out that are not null, and daylight if not null, for
+// the points in rows row0 to row1 - 1 of a grid at one instant, given its
+// ephemeris, as calcSolarRaster(). The output arrays cover the whole grid.
+// Returns false, writing nothing, when no vectorized kernel can run on this
+// machine.
+bool solarKernelRaster(const SolarEphemeris &E, const SolarGrid &grid,
+                       size_t row0, size_t row1, const SolarBatchOut &out,
+                       uint8_t *daylight);
+#endif
+
+#endif
@@ -0,0 +1,533 @@
+/* SolarMath.h
+ * Released into the public domain (originally based on U.S. Govt. products)
+ * No warranty given or implied.
+ *
+ * Math functions used by the solar calculation engine (SolarEngine.h). The
+ * engine takes one of these structures as a template parameter and calls
+ * M::sin(), M::acos() and so on, so the same equations can run on:
+ * 		SolarLibm<T>		- the C math library, for float, double and
+ * 							  long double
+ * 		SolarConstMath<T>	- series expansions that can be evaluated by the
+ * 							  compiler in constexpr context (C++14)
+ * 		SolarVecMath		- branch-free double precision polynomials that
+ * 							  the compiler can vectorize (SolarKernel.cpp)
+ * 		SolarTierMath<T, Tier>	- short polynomials good to the accuracy
+ * 							  tier of a site (initSolarSite())
+ * Each has a tier member giving the SOLAR_TIER_ value (Solarlib.h) it meets,
+ * which the engine copies into its results.
+ */
+#ifndef SolarMath_h
+#define SolarMath_h
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "Solarlib.h"
+
+// Engine functions are constexpr when the compiler supports multi-statement
+// constexpr functions (C++14), and plain inline functions otherwise
+#if __cplusplus >= 201402L
+#define SOLAR_CONSTEXPR constexpr
+#define SOLAR_HAS_CONSTEXPR
+#else
+#define SOLAR_CONSTEXPR inline
+#endif
+
+// Math library functions for each scalar type, so the float version calls
+// sinf() and the long double version calls sinl() instead of promoting
+// everything to double.
+template <typename T> struct SolarLibm;
+template <> struct SolarLibm<float> {
+	static const int tier = SOLAR_TIER_FULL;
+	static float sin(float x) { return sinf(x); }
+	static float cos(float x) { return cosf(x); }
+	static void sincos(float x, float &s, float &c) { s = sinf(x); c = cosf(x); }
+	static float tan(float x) { return tanf(x); }
+	static float asin(float x) { return asinf(x); }
+	static float acos(float x) { return acosf(x); }
+	static float atan2(float y, float x) { return atan2f(y, x); }
+	static float floor(float x) { return floorf(x); }
+	static float select(bool c, float a, float b) { return c ? a : b; }
+	static float sqrt(float x) { return sqrtf(x); }
+	static float pow(float x, float y) { return powf(x, y); }
+};
+template <> struct SolarLibm<double> {
+	static const int tier = SOLAR_TIER_FULL;
+	static double sin(double x) { return ::sin(x); }
+	static double cos(double x) { return ::cos(x); }
+	static void sincos(double x, double &s, double &c) { s = ::sin(x); c = ::cos(x); }
+	static double tan(double x) { return ::tan(x); }
+	static double asin(double x) { return ::asin(x); }
+	static double acos(double x) { return ::acos(x); }
+	static double atan2(double y, double x) { return ::atan2(y, x); }
+	static double floor(double x) { return ::floor(x); }
+	static double select(bool c, double a, double b) { return c ? a : b; }
+	static double sqrt(double x) { return ::sqrt(x); }
+	static double pow(double x, double y) { return ::pow(x, y); }
+};
+#if !defined(__AVR__)
+// avr-libc has no long double functions (long double is the same as double)
+#define SOLAR_HAS_LONG_DOUBLE
+template <> struct SolarLibm<long double> {
+	static const int tier = SOLAR_TIER_FULL;
+	static long double sin(long double x) { return sinl(x); }
+	static long double cos(long double x) { return cosl(x); }
+	static void sincos(long double x, long double &s, long double &c) { s = sinl(x); c = cosl(x); }
+	static long double tan(long double x) { return tanl(x); }
+	static long double asin(long double x) { return asinl(x); }
+	static long double acos(long double x) { return acosl(x); }
+	static long double atan2(long double y, long double x) { return atan2l(y, x); }
+	static long double floor(long double x) { return floorl(x); }
+	static long double select(bool c, long double a, long double b) { return c ? a : b; }
+	static long double sqrt(long double x) { return sqrtl(x); }
+	static long double pow(long double x, long double y) { return powl(x, y); }
+};
+#endif
+
+// Math functions written out as series, usable at compile time. Results are
+// accurate to a few units in the last place of a double for the argument
+// ranges the solar equations use. pow() only handles whole number
+// exponents, which is all the engine needs.
+template <typename T>
+struct SolarConstMath {
+	static const int tier = SOLAR_TIER_FULL;
+	static SOLAR_CONSTEXPR T pi() { return T(3.14159265358979323846264338327950288L); }
+	static SOLAR_CONSTEXPR T select(bool c, T a, T b) { return c ? a : b; }
+	static SOLAR_CONSTEXPR T floor(T x) {
+		long long i = (long long)x;
+		return (x < (T)i) ? (T)(i - 1) : (T)i;
+	}
+	static SOLAR_CONSTEXPR T sqrt(T x) {
+		if (x <= 0) return 0;
+		// Newton's method from a starting guess near the root
+		T r = x > 1 ? x : T(1);
+		for (int i = 0; i < 100; i++) {
+			T next = (r + x / r) / 2;
+			if (next >= r) break;
+			r = next;
+		}
+		return r;
+	}
+	static SOLAR_CONSTEXPR T sin(T x) {
+		// Reduce to -pi..pi, then sum the Taylor series
+		x = x - 2 * pi() * floor((x + pi()) / (2 * pi()));
+		T term = x;
+		T sum = x;
+		for (int n = 1; n < 30; n++) {
+			term = -term * x * x / ((2 * n) * (2 * n + 1));
+			sum += term;
+		}
+		return sum;
+	}
+	static SOLAR_CONSTEXPR T cos(T x) {
+		return sin(x + pi() / 2);
+	}
+	static SOLAR_CONSTEXPR void sincos(T x, T &s, T &c) {
+		s = sin(x);
+		c = cos(x);
+	}
+	static SOLAR_CONSTEXPR T tan(T x) {
+		return sin(x) / cos(x);
+	}
+	static SOLAR_CONSTEXPR T atan(T x) {
+		if (x < 0) return -atan(-x);
+		if (x > 1) return pi() / 2 - atan(1 / x);
+		// Halve the angle twice so the series converges quickly, then sum it
+		x = x / (1 + sqrt(1 + x * x));
+		x = x / (1 + sqrt(1 + x * x));
+		T term = x;
+		T sum = x;
+		for (int n = 1; n < 40; n++) {
+			term = -term * x * x;
+			sum += term / (2 * n + 1);
+		}
+		return 4 * sum;
+	}
+	static SOLAR_CONSTEXPR T atan2(T y, T x) {
+		if (x > 0) return atan(y / x);
+		if (x < 0) return y >= 0 ? atan(y / x) + pi() : atan(y / x) - pi();
+		return y > 0 ? pi() / 2 : (y < 0 ? -pi() / 2 : T(0));
+	}
+	static SOLAR_CONSTEXPR T asin(T x) {
+		if (x > 1 || x < -1) return T(__builtin_nan(""));
+		return atan2(x, sqrt(1 - x * x));
+	}
+	static SOLAR_CONSTEXPR T acos(T x) {
+		if (x > 1 || x < -1) return T(__builtin_nan(""));
+		return atan2(sqrt(1 - x * x), x);
+	}
+	static SOLAR_CONSTEXPR T pow(T x, T y) {
+		int n = (int)y;
+		T r = 1;
+		for (int i = 0; i < (n < 0 ? -n : n); i++) r *= x;
+		return n < 0 ? 1 / r : r;
+	}
+};
+
+// Double precision functions with no branches, library calls or errno, so
+// that a loop calling them can be vectorized by the compiler. Each candidate
+// result is worked out in full and one is then picked with ?: on plain
+// values, which the compiler turns into a blend. The polynomials are those
+// of the Cephes library and are good to about 1e-16 relative; floor() works
+// for |x| < 2^31, which covers every angle the solar equations use.
+// Arguments outside the domain of asin() and acos() are clamped to +/-1
+// rather than giving NaN.
+struct SolarVecMath {
+	static const int tier = SOLAR_TIER_FULL;
+	static inline double pi() { return 3.14159265358979323846; }
+	// c ? a : b, done on the bit patterns. Written with ?:, the compiler may
+	// move the work for a or b under a branch, which stops vectorization.
+	static inline double select(bool c, double a, double b) {
+		int64_t ia, ib;
+		memcpy(&ia, &a, sizeof(ia));
+		memcpy(&ib, &b, sizeof(ib));
+		int64_t mask = -(int64_t)c;
+		int64_t r = (ia & mask) | (ib & ~mask);
+		double d;
+		memcpy(&d, &r, sizeof(d));
+		return d;
+	}
+	static inline double floor(double x) {
+		double t = (double)(int32_t)x;
+		return select(t > x, t - 1, t);
+	}
+	// Square root from the bit pattern estimate of 1/sqrt(x) and four Newton
+	// steps, since sqrt() itself may set errno and cannot be vectorized
+	static inline double sqrt(double x) {
+		int64_t i;
+		memcpy(&i, &x, sizeof(i));
+		i = 0x5fe6eb50c7b537a9LL - (i >> 1);
+		double y;
+		memcpy(&y, &i, sizeof(y));
+		double h = 0.5 * x;
+		y = y * (1.5 - h * y * y);
+		y = y * (1.5 - h * y * y);
+		y = y * (1.5 - h * y * y);
+		y = y * (1.5 - h * y * y);
+		double r = x * y;
+		return select(x > 0, r, 0);
+	}
+	// sin(x) and cos(x) together, sharing the argument reduction
+	static inline void sincos(double x, double &s, double &c) {
+		// Nearest multiple of pi/2, subtracted in three parts so the
+		// remainder keeps full precision
+		double k = floor(x * 0.63661977236758134308 + 0.5);
+		double r = ((x - k * 1.57079625129699707031) -
+					k * 7.54978941586159635336e-8) -
+					k * 5.39030285815811905290e-15;
+		double z = r * r;
+		double ps = r + r * z * (((((1.58962301576546568060e-10 * z -
+					2.50507477628578072866e-8) * z +
+					2.75573136213857245213e-6) * z -
+					1.98412698295895385996e-4) * z +
+					8.33333333332211858878e-3) * z -
+					1.66666666666666307295e-1);
+		double pc = 1 - 0.5 * z + z * z * (((((-1.13585365213876817300e-11 *
+					z + 2.08757008419747316778e-9) * z -
+					2.75573141792967388112e-7) * z +
+					2.48015872888517045348e-5) * z -
+					1.38888888888730564116e-3) * z +
+					4.16666666666665929218e-2);
+		// Quadrant 0 to 3 picks which polynomial, and its sign
+		double q = k - 4 * floor(k * 0.25);
+		bool odd = (q == 1) | (q == 3);
+		double sv = select(odd, pc, ps);
+		double cv = select(odd, ps, pc);
+		s = select(q >= 2, -sv, sv);
+		c = select((q == 1) | (q == 2), -cv, cv);
+	}
+	static inline double sin(double x) {
+		double s, c;
+		sincos(x, s, c);
+		return s;
+	}
+	static inline double cos(double x) {
+		double s, c;
+		sincos(x, s, c);
+		return c;
+	}
+	static inline double tan(double x) {
+		double s, c;
+		sincos(x, s, c);
+		return s / c;
+	}
+	// atan(x) for x from 0 to 1
+	static inline double atan01(double x) {
+		bool big = x > 0.66;
+		double xr = select(big, (x - 1) / (x + 1), x);
+		double z = xr * xr;
+		double p = ((((-8.750608600031904122785e-1 * z -
+					1.615753718733365076637e1) * z -
+					7.500855792314704667340e1) * z -
+					1.228866684490136173410e2) * z -
+					6.485021904942025371773e1);
+		double q = ((((z + 2.485846490142306297962e1) * z +
+					1.650270098316988542046e2) * z +
+					4.328810604912902668951e2) * z +
+					4.853903996359136964868e2) * z +
+					1.945506571482613964425e2;
+		double r = xr + xr * z * p / q;
+		double rb = 0.78539816339744830962 + (r + 3.061616997868382943065e-17);
+		return select(big, rb, r);
+	}
+	static inline double atan2(double y, double x) {
+		double ax = select(x < 0, -x, x);
+		double ay = select(y < 0, -y, y);
+		// Divide the smaller by the larger so the ratio is 0 to 1
+		bool swap = ay > ax;
+		double num = select(swap, ax, ay);
+		double den = select(swap, ay, ax);
+		double ratio = select(den > 0, num / den, 0);
+		double a = atan01(ratio);
+		a = select(swap, pi() / 2 - a, a);
+		a = select(x < 0, pi() - a, a);
+		return select(y < 0, -a, a);
+	}
+	// x limited to -1 to 1
+	static inline double clamp1(double x) {
+		double c = select(x > 1, 1, x);
+		return select(c < -1, -1, c);
+	}
+	static inline double asin(double x) {
+		double c = clamp1(x);
+		return atan2(c, sqrt((1 - c) * (1 + c)));
+	}
+	static inline double acos(double x) {
+		double c = clamp1(x);
+		return atan2(sqrt((1 - c) * (1 + c)), c);
+	}
+};
+
+// Work on the bit pattern of a float or double, whose unsigned integer of the
+// same size is U, for SolarTierMath below. A sign is flipped or cleared on the
+// bits rather than with ?:, which the compiler may turn into a branch.
+// nearest() adds 1.5 * 2^23 (float) or 1.5 * 2^52 (double), which pushes the
+// fraction out of the mantissa with the processor's round to nearest and
+// leaves the whole number in the low bits; that needs T kept at its own
+// precision, so a compiler that works in a wider type (FLT_EVAL_METHOD other
+// than 0, as on the 387) gets the conversion to long below instead.
+template <typename T, typename U>
+struct SolarBitOps {
+	static U bits(T x) {
+		U i;
+		memcpy(&i, &x, sizeof(i));
+		return i;
+	}
+	static T value(U i) {
+		T x;
+		memcpy(&x, &i, sizeof(x));
+		return x;
+	}
+	static U sign() { return (U)1 << (sizeof(U) * 8 - 1); }
+	// c ? -x : x
+	static T negate(bool c, T x) { return value(bits(x) ^ ((U)c * sign())); }
+	static T abs(T x) { return value(bits(x) & ~sign()); }
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+	// The whole number nearest x, with k set to it (at least its low bit),
+	// for |x| below 2^22
+	static T nearest(T x, long &k) {
+		const T shift = sizeof(U) == 4 ? T(12582912.0) : T(6755399441055744.0);
+		T y = x + shift;
+		k = (long)(bits(y) & 0xffff);
+		return y - shift;
+	}
+#else
+	static T nearest(T x, long &k) {
+		k = (long)(x + T(0.5));
+		k -= x + T(0.5) < (T)k;
+		return (T)k;
+	}
+#endif
+};
+// long double, which has no integer of its size, keeps ?:
+template <typename T, int Bytes = sizeof(T)>
+struct SolarBits {
+	static T negate(bool c, T x) { return c ? -x : x; }
+	static T abs(T x) { return x < 0 ? -x : x; }
+	static T nearest(T x, long &k) {
+		k = (long)(x + T(0.5));
+		k -= x + T(0.5) < (T)k;
+		return (T)k;
+	}
+};
+template <typename T>
+struct SolarBits<T, 4> : SolarBitOps<T, uint32_t> {};
+template <typename T>
+struct SolarBits<T, 8> : SolarBitOps<T, uint64_t> {};
+
+// Short polynomials for the SOLAR_TIER_FINE and SOLAR_TIER_COARSE tiers.
+// sincos() reduces the argument once, by whole half turns subtracted in two
+// parts so the remainder stays exact, and evaluates a sine and a cosine
+// polynomial on what is left; sin(), cos() and tan() are built on it, so
+// the sine and cosine of one angle share the work once inlined. asin() and
+// acos() evaluate one polynomial, on |x| or, past 1/2, on sqrt((1 - |x|)/2),
+// and atan2() one on the smaller of its arguments over the larger, brought
+// to 0..tan(pi/8) within the same division. sqrt() and floor() are worked
+// out here too, so nothing goes to the C library, and the polynomials are
+// split in two halves the processor can work on side by side. Each tier has
+// the fewest terms that keep the results within its tolerance (see
+// extras/tiers/README.md); the largest error of each polynomial on its range
+// is given beside it. Arguments to sin(), cos(), tan() and floor() must be
+// below 2^22 in size.
+template <typename T, int Tier>
+struct SolarTierMath {
+	typedef SolarBits<T> B;
+	static const int tier = Tier;
+	static const bool coarse = Tier == SOLAR_TIER_COARSE;
+	static T pi() { return T(3.14159265358979323846); }
+	static T select(bool c, T a, T b) { return c ? a : b; }
+	// The nearest whole number, less one where that is above x
+	static T floor(T x) {
+		long k = 0;
+		T r = B::nearest(x, k);
+		return r - select(r > x, 1, 0);
+	}
+	// The bit pattern of x as a float, read as a whole number and halved,
+	// is close to that of 1/sqrt(x); each Newton step then doubles the
+	// correct digits, 3e-11 after three. x must be from 0 to 1e38.
+	static T sqrt(T x) {
+		float f = (float)x;
+		uint32_t i;
+		memcpy(&i, &f, sizeof(i));
+		i = 0x5f3759dfUL - (i >> 1);
+		memcpy(&f, &i, sizeof(f));
+		T y = f;
+		T h = T(0.5) * x;
+		y = y * (T(1.5) - h * y * y);
+		y = y * (T(1.5) - h * y * y);
+		y = y * (T(1.5) - h * y * y);
+		return x * y;
+	}
+	// sin(r) for |r| <= pi/2
+	static T sinPoly(T r) {
+		T z = r * r;
+		T z2 = z * z;
+		if (coarse) {
+			// 1.2e-8
+			return r * ((T(0.999999999158245) + z * T(-0.16666662483617917)) +
+					z2 * ((T(0.0083331307782183971) +
+					z * T(-0.00019813423871460514)) +
+					z2 * T(2.6125380358371349e-06)));
+		}
+		// 6.9e-11
+		return r * ((T(0.9999999999987953) + z * T(-0.1666666665461862)) +
+				z2 * ((T(0.0083333322485951624) + z * T(-0.0001984100291255655)) +
+				z2 * (T(2.7531529591516387e-06) +
+				z * T(-2.3984738312073641e-08))));
+	}
+	// cos(r) for |r| <= pi/2
+	static T cosPoly(T r) {
+		T z = r * r;
+		T z2 = z * z;
+		if (coarse) {
+			// 4.7e-8
+			return (T(0.99999995346667148) + z * T(-0.49999905347078566)) +
+					z2 * ((T(0.041663584693149049) +
+					z * T(-0.001385370430851865)) +
+					z2 * T(2.3153931665056308e-05));
+		}
+		// 7.5e-13
+		return (T(0.99999999999925182) + z * T(-0.49999999997023969)) +
+				z2 * ((T(0.041666666473382102) + z * T(-0.0013888884179956856)) +
+				z2 * ((T(2.4801040644544617e-05) +
+				z * T(-2.7524696243467118e-07)) +
+				z2 * T(1.9907855031355933e-09)));
+	}
+	static void sincos(T x, T &s, T &c) {
+		// Nearest whole number of half turns, and what is left; both
+		// change sign over each odd half turn
+		long k = 0;
+		T kf = B::nearest(x * T(0.31830988618379067154), k);
+		T r = (x - kf * T(3.14159265346825122834)) -
+			  kf * T(1.21542010130123844986e-10);
+		T sign = (T)(1 - 2 * (k & 1));
+		s = sign * sinPoly(r);
+		c = sign * cosPoly(r);
+	}
+	static T sin(T x) {
+		T s, c;
+		sincos(x, s, c);
+		return s;
+	}
+	static T cos(T x) {
+		T s, c;
+		sincos(x, s, c);
+		return c;
+	}
+	static T tan(T x) {
+		T s, c;
+		sincos(x, s, c);
+		return s / c;
+	}
+	// asin(x) for 0 <= x <= 1/2
+	static T asinPoly(T x) {
+		T z = x * x;
+		T z2 = z * z;
+		if (coarse) {
+			// 7.5e-8
+			return x * ((T(1.0000000138426717) + z * T(0.16665988916540087)) +
+					z2 * ((T(0.075318679666588326) + z * T(0.040512942219592812)) +
+					z2 * T(0.049186012475604238)));
+		}
+		// 4.6e-10
+		T z4 = z2 * z2;
+		return x * (((T(1.000000000005077) + z * T(0.16666665755265289)) +
+				z2 * (T(0.07500138934573905) + z * T(0.044587790153806255))) +
+				z4 * ((T(0.031228982186393875) + z * T(0.016539980005023242)) +
+				z2 * T(0.034714469197308535)));
+	}
+	// atan(r) for |r| <= tan(pi/8)
+	static T atanPoly(T r) {
+		T z = r * r;
+		T z2 = z * z;
+		if (coarse) {
+			// 2.8e-7
+			return r * ((T(0.99999971135078358) + z * T(-0.33324393362763116)) +
+					z2 * (T(0.19690738693920024) +
+					z * T(-0.11108601769179517)));
+		}
+		// 6.3e-10
+		return r * ((T(0.99999999995418198) + z * T(-0.33333326739251118)) +
+				z2 * ((T(0.19999141449932595) + z * T(-0.14254836081814518)) +
+				z2 * (T(0.1066702006614705) + z * T(-0.062397929310437333))));
+	}
+	static T atan2(T y, T x) {
+		T ax = B::abs(x);
+		T ay = B::abs(y);
+		// The smaller over the larger is 0 to 1; above tan(pi/8), take
+		// pi/4 off the angle, which makes the ratio (num - den)/(num + den)
+		bool swap = ay > ax;
+		T num = select(swap, ax, ay);
+		T den = select(swap, ay, ax);
+		bool mid = num > T(0.41421356237309505) * den;
+		T n = select(mid, num - den, num);
+		T d = select(mid, num + den, den);
+		T q = n / d;
+		T a = select(mid, pi() / 4, 0) + atanPoly(select(d > 0, q, 0));
+		a = select(swap, pi() / 2 - a, a);
+		a = select(x < 0, pi() - a, a);
+		return B::negate(y < 0, a);
+	}
+	static T atan(T x) {
+		return atan2(x, 1);
+	}
+	// How far the terms the engine passes to asin() and acos() can land
+	// outside -1..1 through the error of the other functions. Further out
+	// gives NaN, as the library functions do.
+	static T slack() { return coarse ? T(1e-6) : T(1e-9); }
+	static T asin(T x) {
+		T a = B::abs(x);
+		T out = select(a > 1 + slack(), T(NAN), 0);
+		a = select(a > 1, 1, a);
+		bool big = a > T(0.5);
+		T p = asinPoly(select(big, sqrt((1 - a) * T(0.5)), a));
+		T r = select(big, pi() / 2 - 2 * p, p) + out;
+		return B::negate(x < 0, r);
+	}
+	static T acos(T x) {
+		return pi() / 2 - asin(x);
+	}
+};
+
+#endif
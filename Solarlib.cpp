@@ -52,361 +52,1759 @@
  * Raoul Smeets, Avans University of Applied Science
 
 */
-#include "Arduino.h"
-#include "math.h"
-#include "Time.h"
+#include <stdlib.h>
+#include <string.h>
 #include "Solarlib.h"
+#include "SolarEngine.h"
+#include "SolarKernel.h"
+// Ephemeris files are mapped into memory where there is mmap()
+#if !defined(ARDUINO) && (defined(__unix__) || defined(__APPLE__))
+#define SOLAR_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(SOLARLIB_THREADS)
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
 
-static SolarElements SE; // cache that holds all calculated values
+// Work is handed to threads in pieces of these many rows (batch and fleet)
+// or grid rows (raster). They are whole kernel blocks and tiles, so every
+// row is calculated by the same code whatever the number of threads, and
+// the results do not depend on it.
+#define SOLAR_BATCH_GRAIN	(16 * SOLAR_BLOCK)
+#define SOLAR_RASTER_GRAIN	SOLAR_TILE_ROWS
 
-// initSolar function
-void initSolarCalc(int tzOffset, double lat, double lon){
+// Starting and joining a thread costs about as much as working out a few
+// hundred points, so a thread is only started for at least this many (rows
+// of a batch or fleet, or grid points), and small calls run on the calling
+// thread alone
+#define SOLAR_THREAD_MIN_POINTS	(4 * SOLAR_BATCH_GRAIN)
+
+// Threads requested with setSolarThreads(), 0 for one per core. Atomic, as
+// it may be set while other threads are reading it.
+#if defined(SOLARLIB_THREADS)
+static std::atomic<unsigned int> solarThreads(0);
+#else
+static unsigned int solarThreads = 0;
+#endif
+
+// Run job(begin, end) over the range [0, n), split into pieces of grain
+// (the last may be shorter), where each unit of the range is the given
+// number of points. With SOLARLIB_THREADS the pieces are shared out in
+// order among the threads, a run of them each, and the calling thread works
+// through the first run; otherwise job runs once for the whole range.
+template <class Job>
+static void solarParallel(size_t n, size_t points, size_t grain,
+						  const Job &job){
+	unsigned int threads = getSolarThreads();
+	size_t pieces = (n + grain - 1) / grain;
+	if (threads > pieces) threads = (unsigned int)pieces;
+	size_t most = n * points / SOLAR_THREAD_MIN_POINTS;
+	if (threads > most) threads = (unsigned int)most;
+	if (threads <= 1) {
+		if (n) job(0, n);
+		return;
+	}
+#if defined(SOLARLIB_THREADS)
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	for (unsigned int k = 1; k < threads; k++) {
+		size_t begin = pieces * k / threads * grain;
+		size_t end = pieces * (k + 1) / threads * grain;
+		if (end > n) end = n;
+		workers.push_back(std::thread(job, begin, end));
+	}
+	job(0, pieces / threads * grain);
+	for (size_t k = 0; k < workers.size(); k++) workers[k].join();
+#endif
+}
+
+template <typename T>
+static void runSolarStages(time_t t, SolarElementsT<T> &SE,
+                           unsigned int stages);
+template <typename T>
+static void runSolarStagesAt(long unixDays, T timeFracDay,
+                             const SolarSiteT<T> &site, SolarElementsT<T> &SE,
+                             unsigned int stages);
+
+// Call job.run<M>() with M the math functions for T of the given tier. The
+// engine is a template on M, so each tier is its own copy of the engine with
+// its functions inlined.
+template <typename T, class Job>
+static void solarTierRun(int tier, const Job &job){
+	if (tier == SOLAR_TIER_COARSE) {
+		job.template run<SolarTierMath<T, SOLAR_TIER_COARSE> >();
+	} else if (tier == SOLAR_TIER_FINE) {
+		job.template run<SolarTierMath<T, SOLAR_TIER_FINE> >();
+	} else {
+		job.template run<SolarLibm<T> >();
+	}
+}
+
+// The engine entry points, as jobs for solarTierRun()
+template <typename T, class S>
+struct SolarStagesJob {
+	long unixDays;
+	T timeFracDay;
+	SolarElementsT<T> *SE;
+	const S *site;
+	unsigned int stages;
+	template <class M> void run() const {
+		solarStagesAt<T, M>(unixDays, timeFracDay, *SE, *site, stages);
+	}
+};
+template <typename T, class P, class S>
+struct SolarPositionJob {
+	T SDec;
+	T EOT;
+	T utcMinutes;
+	P *out;
+	const S *site;
+	unsigned int stages;
+	template <class M> void run() const {
+		solarPositionStages<T, M>(*out, SDec, EOT, utcMinutes, *site, stages);
+	}
+};
+template <typename T>
+struct SolarEphemerisJob {
+	long unixDays;
+	T utcMinutes;
+	SolarEphemerisT<T> *E;
+	template <class M> void run() const {
+		solarEphemerisAt<T, M>(unixDays, utcMinutes, *E);
+	}
+};
+// With noonGiven, from the declination and equation of time at local noon
+template <typename T, class S>
+struct SolarDayJob {
+	long unixDays;
+	const S *site;
+	SolarDayT<T> *SD;
+	bool noonGiven;
+	T SDec;
+	T EOT;
+	template <class M> void run() const {
+		if (noonGiven) solarDayFrom<T, M>(unixDays, *site, SDec, EOT, *SD);
+		else solarDay<T, M>(unixDays, *site, *SD);
+	}
+};
+
+//----------------------------------------------------------------------------
+// SolarContext methods
+SolarContext::SolarContext(){
+	site.tier = SOLAR_TIER_FULL;
+	site.file = 0;
+	init(0, 0, 0);
+	resetCacheStats();
+}
+SolarContext::SolarContext(int tzOffset, double lat, double lon){
+	site.tier = SOLAR_TIER_FULL;
+	site.file = 0;
+	init(tzOffset, lat, lon);
+	resetCacheStats();
+}
+// Set the site for this context
+void SolarContext::init(int tzOffset, double lat, double lon){
 	SE.tzOffset = tzOffset; // Set time zone offset
 	SE.lat = lat;	// Set current site latitude
 	SE.lon = lon;	// Set current site longitude
+	const SolarEphemerisFile *file = site.file;
+	initSolarSite(site, tzOffset, lat, lon, site.tier);
+	site.file = file;
+	cachedStages = 0;	// Results for any previous site are now stale
+	dayValid = false;
+	keyT = 0;
+	keyTzOffset = tzOffset;
+	keyLat = lat;
+	keyLon = lon;
+	keyFileGen = 0;
+	dayFileGen = 0;
+}
+// Change the tier of the math functions. The site values do not depend on
+// it, but every cached result does.
+bool SolarContext::setTier(int tier){
+	if (tier != SOLAR_TIER_FULL && tier != SOLAR_TIER_FINE &&
+		tier != SOLAR_TIER_COARSE) return false;
+	if (tier != site.tier) {
+		site.tier = tier;
+		cachedStages = 0;
+		dayValid = false;
+	}
+	return true;
+}
+int SolarContext::getTier(){
+	return site.tier;
+}
+void SolarContext::setEphemerisFile(const SolarEphemerisFile *file){
+	site.file = file;
+	cachedStages = 0;
+	dayValid = false;
+}
+const SolarEphemerisFile *SolarContext::getEphemerisFile(){
+	return site.file;
 }
 // Return time zone offset when user asks for it. 
 // Zones west of GMT are negative.
-int gettzOffset(){
+int SolarContext::gettzOffset(){
 	return SE.tzOffset;
 }
 // Return latitude when user asks for it.
-double getlat(){
+double SolarContext::getlat(){
 	return SE.lat;
 }
 // Return longitude when user asks for it.
-double getlon(){
+double SolarContext::getlon(){
 	return SE.lon;
 }
-double gettimeFracDay(time_t t){
-	calcSolar(t, SE);
+double SolarContext::gettimeFracDay(time_t t){
+	update(t, SOLAR_TIME);
 	return SE.timeFracDay;
 }
-long getunixDays(time_t t){
-	calcSolar(t, SE);
+long SolarContext::getunixDays(time_t t){
+	update(t, SOLAR_TIME);
 	return SE.unixDays;
 }
-double getJDN(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getJDN(time_t t){
+	update(t, SOLAR_TIME);
 	return SE.JDN;
 }
 // Extract Julian Century
-double getJCN(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getJCN(time_t t){
+	update(t, SOLAR_TIME);
 	return SE.JCN;
 }
 // Extract GMLS
-double getGMLS(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getGMLS(time_t t){
+	update(t, SOLAR_MEAN);
 	return SE.GMLS;
 }
-double getGMAS(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getGMAS(time_t t){
+	update(t, SOLAR_MEAN);
 	return SE.GMAS;
 }
 // Extract Eccentricity of Earth Orbit
-double getEEO(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getEEO(time_t t){
+	update(t, SOLAR_MEAN);
 	return SE.EEO;
 }
 // Extract Sun Equation of Center
-double getSEC(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSEC(time_t t){
+	update(t, SOLAR_CENTER);
 	return SE.SEC;
 }
 // Extract Sun True Longitude (degrees)  
-double getSTL(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSTL(time_t t){
+	update(t, SOLAR_CENTER);
 	return SE.STL;
 }
 // Extract Sun True Anomaly (degrees)
-double getSTA(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSTA(time_t t){
+	update(t, SOLAR_CENTER);
 	return SE.STA;
 }
 // Extract Sun Radian Vector
-double getSRV(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSRV(time_t t){
+	update(t, SOLAR_CENTER);
 	return SE.SRV;
 }
 // Extract Sun Apparent Longitude (degrees)
-double getSAL(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSAL(time_t t){
+	update(t, SOLAR_OBLIQUITY);
 	return SE.SAL;
 }
 // Extract Mean Oblique Ecliptic (degrees)
-double getMOE(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getMOE(time_t t){
+	update(t, SOLAR_OBLIQUITY);
 	return SE.MOE;
 }
 // Extract Oblique correction (degrees)
-double getOC(time_t t){
-	calcSolar(t, SE);
-	return SE.MOE;
+double SolarContext::getOC(time_t t){
+	update(t, SOLAR_OBLIQUITY);
+	return SE.OC;
 }
 // Extract Sun Right Ascension (degrees)
-double getSRA(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSRA(time_t t){
+	update(t, SOLAR_DECLINATION);
 	return SE.SRA;
 }
 // Extract Sun Declination (degrees)
-double getSDec(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSDec(time_t t){
+	update(t, SOLAR_DECLINATION);
 	return SE.SDec;
 }
 // Extract var y
-double getvy(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getvy(time_t t){
+	update(t, SOLAR_EOT);
 	return SE.vy;
 }
 // Extract Equation of Time
-double getEOT(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getEOT(time_t t){
+	update(t, SOLAR_EOT);
 	return SE.EOT;
 }
 // Extract Hour Angle Sunrise (degrees)
-double getHAS(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getHAS(time_t t){
+	update(t, SOLAR_RISESET);
 	return SE.HAS;
 }
 // Extract Solar Noon (fraction of a day)
-double getSolarNoonfrac(time_t t){
-	calcSolar(t,SE);
+double SolarContext::getSolarNoonfrac(time_t t){
+	update(t, SOLAR_NOON);
 	return SE.SolarNoonfrac;
 }
 // Extract Solar Noon Days (days since 1970-1-1, local time zone)
-double getSolarNoonDays(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSolarNoonDays(time_t t){
+	update(t, SOLAR_NOON);
 	return SE.SolarNoonDays;
 }
 // Extract Solar Noon Time (Time object, seconds since 1970-1-1)
-time_t getSolarNoonTime(time_t t){
-	calcSolar(t, SE);
+time_t SolarContext::getSolarNoonTime(time_t t){
+	update(t, SOLAR_NOON);
 	return SE.SolarNoonTime;
 }
 // Extract Sunrise (seconds since 1970-1-1, local time zone)
-double getSunrise(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSunrise(time_t t){
+	update(t, SOLAR_RISESET);
 	return SE.Sunrise;
 }
 // Extract Sunrise as Time object (seconds since 1970-1-1, local time zone)
-time_t getSunriseTime(time_t t){
-	calcSolar(t, SE);
+time_t SolarContext::getSunriseTime(time_t t){
+	update(t, SOLAR_RISESET);
 	return SE.SunriseTime;
 }
 // Extract Sunset (seconds since 1970-1-1, local time zone)
-double getSunset(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSunset(time_t t){
+	update(t, SOLAR_RISESET);
 	return SE.Sunset;
 }
 // Extract Sunset as Time object (seconds since 1970-1-1, local time zone)
-time_t getSunsetTime(time_t t){
-	calcSolar(t, SE);
+time_t SolarContext::getSunsetTime(time_t t){
+	update(t, SOLAR_RISESET);
 	return SE.SunsetTime;
 }
 // Extract Sunlight Duration (day length, minutes)
-double getSunDuration(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSunDuration(time_t t){
+	update(t, SOLAR_RISESET);
 	return SE.SunDuration;
 }
 // Extract True Solar Time (minutes)
-double getTST(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getTST(time_t t){
+	update(t, SOLAR_HOURANGLE);
 	return SE.TST;
 }
 // Extract Hour Angle (degrees)
-double getHA(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getHA(time_t t){
+	update(t, SOLAR_HOURANGLE);
 	return SE.HA;
 }
 // Extract Solar Zenith Angle (degrees)
-double getSZA(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSZA(time_t t){
+	update(t, SOLAR_ZENITH);
 	return SE.SZA;
 }
 // Solar Elevation Angle (degrees above horizontal)
-double getSEA(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSEA(time_t t){
+	update(t, SOLAR_ZENITH);
 	return SE.SEA;
 }
 // Approximate Atmospheric Refraction (degrees)
-double getAAR(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getAAR(time_t t){
+	update(t, SOLAR_REFRACTION);
 	return SE.AAR;
 }
 // Solar Elevation Corrected for Atmospheric refraction (degrees)
-double getSEC_Corr(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSEC_Corr(time_t t){
+	update(t, SOLAR_REFRACTION);
 	return SE.SEC_Corr;
 }
 // Extract Solar Azimuth Angle (degrees clockwise from North)
-double getSAA(time_t t){
-	calcSolar(t, SE);
+double SolarContext::getSAA(time_t t){
+	update(t, SOLAR_AZIMUTH);
 	return SE.SAA;
 }
 
+// Recalculate only when the time value, site or ephemeris file differs from
+// the values the cached results were calculated with, or when the caller
+// needs a stage that has not been calculated yet for this time value.
+void SolarContext::update(time_t t, unsigned int mask){
+	unsigned long fileGen = site.file ? site.file->generation() : 0;
+	if (!(t == keyT && SE.tzOffset == keyTzOffset &&
+			SE.lat == keyLat && SE.lon == keyLon && fileGen == keyFileGen)) {
+		cachedStages = 0;
+	}
+	unsigned int missing = solarResolveMask(mask) & ~cachedStages;
+	if (missing == 0) {
+		cacheHits++;
+		return;
+	}
+	cacheMisses++;
+	long days = 0, secs = 0;
+	solarSplitTime(t, days, secs);
+	SolarStagesJob<double, SolarSite> job = { days, (double)secs / 86400, &SE,
+			&site, missing & ~(SOLAR_NOON | SOLAR_RISESET) };
+	solarTierRun<double>(site.tier, job);
+	if (missing & (SOLAR_NOON | SOLAR_RISESET)) {
+		// Per-day values only need recalculating when the day changes
+		if (!dayValid || day.unixDays != SE.unixDays ||
+				dayFileGen != fileGen) {
+			calcSolarDay(SE.unixDays, site, day);
+			dayValid = true;
+			dayFileGen = fileGen;
+		}
+		copySolarDay(day, SE);
+	}
+	cachedStages |= missing;
+	keyT = t;
+	keyTzOffset = SE.tzOffset;
+	keyLat = SE.lat;
+	keyLon = SE.lon;
+	keyFileGen = fileGen;
+}
+// The columns of out moved on by i rows, for working on part of a batch
+static SolarBatchOut solarOffsetOut(const SolarBatchOut &out, size_t i){
+	SolarBatchOut o;
+	if (out.SDec) o.SDec = out.SDec + i;
+	if (out.EOT) o.EOT = out.EOT + i;
+	if (out.HA) o.HA = out.HA + i;
+	if (out.SZA) o.SZA = out.SZA + i;
+	if (out.SEA) o.SEA = out.SEA + i;
+	if (out.AAR) o.AAR = out.AAR + i;
+	if (out.SEC_Corr) o.SEC_Corr = out.SEC_Corr + i;
+	if (out.SAA) o.SAA = out.SAA + i;
+	if (out.SolarNoonTime) o.SolarNoonTime = out.SolarNoonTime + i;
+	if (out.SunriseTime) o.SunriseTime = out.SunriseTime + i;
+	if (out.SunsetTime) o.SunsetTime = out.SunsetTime + i;
+	return o;
+}
+
+// Work through an array of time values for one site, writing only the
+// requested outputs. Positions come from the block kernel in SolarKernel.cpp
+// where there is one, otherwise each row is built in a copy of SE; either
+// way the ephemeris comes from fit for the times it covers. Per-day values
+// are kept in a local SolarDay, so nothing outside is changed and parts of
+// one batch can be run side by side.
+static void runSolarBatch(const SolarElements &SE, const SolarSite &site,
+		const SolarChebyshev *fit, const int64_t *t, size_t n,
+		const SolarBatchOut &out){
+	unsigned int mask = 0;
+	if (out.SDec) mask |= SOLAR_DECLINATION;
+	if (out.EOT) mask |= SOLAR_EOT;
+	if (out.HA) mask |= SOLAR_HOURANGLE;
+	if (out.SZA || out.SEA) mask |= SOLAR_ZENITH;
+	if (out.AAR || out.SEC_Corr) mask |= SOLAR_REFRACTION;
+	if (out.SAA) mask |= SOLAR_AZIMUTH;
+	if (out.SolarNoonTime) mask |= SOLAR_NOON;
+	if (out.SunriseTime || out.SunsetTime) mask |= SOLAR_RISESET;
+	unsigned int stages = solarResolveMask(mask);
+	bool perDay = (stages & (SOLAR_NOON | SOLAR_RISESET)) != 0;
+	stages &= ~(SOLAR_NOON | SOLAR_RISESET);
+	bool position = (stages & ~SOLAR_TIME) != 0;
+#if defined(SOLAR_HAS_KERNEL)
+	// The block kernel does the positions if it can run on this machine;
+	// only per-day values are then left
+	if (position && solarKernelPositions(t, n, site, out, fit)) {
+		position = false;
+	}
+#endif
+	if (!position && !perDay) return;
+	SolarElements R = SE;
+	SolarDay day;
+	bool dayValid = false;
+	SolarEphemeris E;
+	for (size_t i = 0; i < n; i++) {
+		long days = 0, msOfDay = 0;
+		solarSplitMillis(t[i], days, msOfDay);
+		if (position && fit && fit->eval(t[i] - site.tz * 3600000LL, E)) {
+			// Only the position stages are left to work out
+			R.SDec = E.SDec;
+			R.EOT = E.EOT;
+			SolarPositionJob<double, SolarElements, SolarSite> job = { E.SDec,
+					E.EOT, E.utcMinutes, &R, &site, stages };
+			solarTierRun<double>(site.tier, job);
+		} else if (position) {
+			SolarStagesJob<double, SolarSite> job = { days,
+					(double)msOfDay / 86400000, &R, &site, stages };
+			solarTierRun<double>(site.tier, job);
+		}
+		if (position) {
+			if (out.SDec) out.SDec[i] = R.SDec;
+			if (out.EOT) out.EOT[i] = R.EOT;
+			if (out.HA) out.HA[i] = R.HA;
+			if (out.SZA) out.SZA[i] = R.SZA;
+			if (out.SEA) out.SEA[i] = R.SEA;
+			if (out.AAR) out.AAR[i] = R.AAR;
+			if (out.SEC_Corr) out.SEC_Corr[i] = R.SEC_Corr;
+			if (out.SAA) out.SAA[i] = R.SAA;
+		}
+		if (perDay) {
+			if (!dayValid || day.unixDays != days) {
+				calcSolarDay(days, site, day);
+				dayValid = true;
+			}
+			if (out.SolarNoonTime) out.SolarNoonTime[i] = day.SolarNoonTime;
+			if (out.SunriseTime) out.SunriseTime[i] = day.SunriseTime;
+			if (out.SunsetTime) out.SunsetTime[i] = day.SunsetTime;
+		}
+	}
+}
+
+// Rows [begin, end) of a batch, as a job for solarParallel()
+struct SolarBatchJob {
+	const SolarElements *SE;
+	const SolarSite *site;
+	const SolarChebyshev *fit;
+	const int64_t *t;
+	const SolarBatchOut *out;
+	void operator()(size_t begin, size_t end) const {
+		runSolarBatch(*SE, *site, fit, t + begin, end - begin,
+				solarOffsetOut(*out, begin));
+	}
+};
+
+// Split the batch over the worker threads, if any, in whole kernel blocks
+void SolarContext::calcBatch(const int64_t *t, size_t n,
+		const SolarBatchOut &out, const SolarChebyshev *fit){
+	SolarBatchJob job = { &SE, &site, fit, t, &out };
+	solarParallel(n, 1, SOLAR_BATCH_GRAIN, job);
+}
+unsigned long SolarContext::getCacheHits(){
+	return cacheHits;
+}
+unsigned long SolarContext::getCacheMisses(){
+	return cacheMisses;
+}
+void SolarContext::resetCacheStats(){
+	cacheHits = 0;
+	cacheMisses = 0;
+}
+// Run calcSolar and hand back the full set of results
+const SolarElements &SolarContext::getElements(time_t t){
+	update(t, SOLAR_ALL);
+	return SE;
+}
+
+//----------------------------------------------------------------------------
+// Free functions, operating on the default SolarContext
+// Default context used by the free functions below
+static SolarContext defaultContext;
+
+// initSolar function
+void initSolarCalc(int tzOffset, double lat, double lon){
+	defaultContext.init(tzOffset, lat, lon);
+}
+int gettzOffset(){
+	return defaultContext.gettzOffset();
+}
+double getlat(){
+	return defaultContext.getlat();
+}
+double getlon(){
+	return defaultContext.getlon();
+}
+double gettimeFracDay(time_t t){
+	return defaultContext.gettimeFracDay(t);
+}
+long getunixDays(time_t t){
+	return defaultContext.getunixDays(t);
+}
+double getJDN(time_t t){
+	return defaultContext.getJDN(t);
+}
+double getJCN(time_t t){
+	return defaultContext.getJCN(t);
+}
+double getGMLS(time_t t){
+	return defaultContext.getGMLS(t);
+}
+double getGMAS(time_t t){
+	return defaultContext.getGMAS(t);
+}
+double getEEO(time_t t){
+	return defaultContext.getEEO(t);
+}
+double getSEC(time_t t){
+	return defaultContext.getSEC(t);
+}
+double getSTL(time_t t){
+	return defaultContext.getSTL(t);
+}
+double getSTA(time_t t){
+	return defaultContext.getSTA(t);
+}
+double getSRV(time_t t){
+	return defaultContext.getSRV(t);
+}
+double getSAL(time_t t){
+	return defaultContext.getSAL(t);
+}
+double getMOE(time_t t){
+	return defaultContext.getMOE(t);
+}
+double getOC(time_t t){
+	return defaultContext.getOC(t);
+}
+double getSRA(time_t t){
+	return defaultContext.getSRA(t);
+}
+double getSDec(time_t t){
+	return defaultContext.getSDec(t);
+}
+double getvy(time_t t){
+	return defaultContext.getvy(t);
+}
+double getEOT(time_t t){
+	return defaultContext.getEOT(t);
+}
+double getHAS(time_t t){
+	return defaultContext.getHAS(t);
+}
+double getSolarNoonfrac(time_t t){
+	return defaultContext.getSolarNoonfrac(t);
+}
+double getSolarNoonDays(time_t t){
+	return defaultContext.getSolarNoonDays(t);
+}
+time_t getSolarNoonTime(time_t t){
+	return defaultContext.getSolarNoonTime(t);
+}
+double getSunrise(time_t t){
+	return defaultContext.getSunrise(t);
+}
+time_t getSunriseTime(time_t t){
+	return defaultContext.getSunriseTime(t);
+}
+double getSunset(time_t t){
+	return defaultContext.getSunset(t);
+}
+time_t getSunsetTime(time_t t){
+	return defaultContext.getSunsetTime(t);
+}
+double getSunDuration(time_t t){
+	return defaultContext.getSunDuration(t);
+}
+double getTST(time_t t){
+	return defaultContext.getTST(t);
+}
+double getHA(time_t t){
+	return defaultContext.getHA(t);
+}
+double getSZA(time_t t){
+	return defaultContext.getSZA(t);
+}
+double getSEA(time_t t){
+	return defaultContext.getSEA(t);
+}
+double getAAR(time_t t){
+	return defaultContext.getAAR(t);
+}
+double getSEC_Corr(time_t t){
+	return defaultContext.getSEC_Corr(t);
+}
+double getSAA(time_t t){
+	return defaultContext.getSAA(t);
+}
+unsigned long getSolarCacheHits(){
+	return defaultContext.getCacheHits();
+}
+unsigned long getSolarCacheMisses(){
+	return defaultContext.getCacheMisses();
+}
+void resetSolarCacheStats(){
+	defaultContext.resetCacheStats();
+}
+void calcSolarBatch(const int64_t *t, size_t n, const SolarBatchOut &out,
+		const SolarChebyshev *fit){
+	defaultContext.calcBatch(t, n, out, fit);
+}
+void calcSolarBatch(const int64_t *t, size_t n, SolarColumns &cols,
+		const SolarChebyshev *fit){
+	if (n > cols.size()) n = cols.size();
+	defaultContext.calcBatch(t, n, cols.out(), fit);
+}
+// Positions for sites [begin, end) of a registry, from a shared ephemeris.
+// The fleet kernel does the sites if it can run on this machine, otherwise
+// they go one at a time through calcSolarPosition().
+static void runSolarFleet(const SolarEphemeris &E,
+		const SolarSiteRegistry &sites, size_t begin, size_t end,
+		const SolarBatchOut &out){
+#if defined(SOLAR_HAS_KERNEL)
+	if (solarKernelFleet(E, sites.sinLat() + begin, sites.cosLat() + begin,
+						 sites.lonMinutes() + begin, end - begin,
+						 solarOffsetOut(out, begin))) return;
+#endif
+	// Only the fields calcSolarPosition() reads are filled in
+	SolarSite site = SolarSite();
+	SolarPosition P = SolarPosition();
+	for (size_t i = begin; i < end; i++) {
+		site.tz = sites.tzOffset()[i];
+		site.latDeg = sites.lat()[i];
+		site.lonDeg = sites.lon()[i];
+		site.sinLatV = sites.sinLat()[i];
+		site.cosLatV = sites.cosLat()[i];
+		site.lonMin = sites.lonMinutes()[i];
+		calcSolarPosition(E, site, P);
+		if (out.SDec) out.SDec[i] = E.SDec;
+		if (out.EOT) out.EOT[i] = E.EOT;
+		if (out.HA) out.HA[i] = P.HA;
+		if (out.SZA) out.SZA[i] = P.SZA;
+		if (out.SEA) out.SEA[i] = P.SEA;
+		if (out.AAR) out.AAR[i] = P.AAR;
+		if (out.SEC_Corr) out.SEC_Corr[i] = P.SEC_Corr;
+		if (out.SAA) out.SAA[i] = P.SAA;
+	}
+}
+
+// Sites [begin, end) of a fleet, as a job for solarParallel()
+struct SolarFleetJob {
+	const SolarEphemeris *E;
+	const SolarSiteRegistry *sites;
+	const SolarBatchOut *out;
+	void operator()(size_t begin, size_t end) const {
+		runSolarFleet(*E, *sites, begin, end, *out);
+	}
+};
+
+// The ephemeris is worked out once, then the first n sites are split over
+// the worker threads, if any
+static void solarFleet(int64_t utcMillis, const SolarSiteRegistry &sites,
+		size_t n, const SolarBatchOut &out){
+	SolarEphemeris E;
+	calcSolarEphemerisMillis(utcMillis, E);
+	SolarFleetJob job = { &E, &sites, &out };
+	solarParallel(n, 1, SOLAR_BATCH_GRAIN, job);
+}
+void calcSolarFleet(int64_t utcMillis, const SolarSiteRegistry &sites,
+		const SolarBatchOut &out){
+	solarFleet(utcMillis, sites, sites.size(), out);
+}
+void calcSolarFleet(int64_t utcMillis, const SolarSiteRegistry &sites,
+		SolarColumns &cols){
+	size_t n = sites.size();
+	if (n > cols.size()) n = cols.size();
+	solarFleet(utcMillis, sites, n, cols.out());
+}
+
+// Positions for grid rows [row0, row1) at one instant, from a shared
+// ephemeris. The raster kernel does the rows if it can run on this machine,
+// otherwise each point goes through calcSolarPosition(), with the site
+// prepared once per row.
+static void runSolarRaster(const SolarEphemeris &E, const SolarGrid &grid,
+		size_t row0, size_t row1, const SolarBatchOut &out,
+		uint8_t *daylight){
+#if defined(SOLAR_HAS_KERNEL)
+	if (solarKernelRaster(E, grid, row0, row1, out, daylight)) return;
+#endif
+	SolarSite site;
+	SolarPosition P = SolarPosition();
+	for (size_t r = row0; r < row1; r++) {
+		initSolarSite(site, 0, grid.lat0 + (double)r * grid.dLat, grid.lon0);
+		for (size_t c = 0; c < grid.cols; c++) {
+			site.lonDeg = grid.lon0 + (double)c * grid.dLon;
+			site.lonMin = 4 * site.lonDeg;
+			calcSolarPosition(E, site, P);
+			size_t i = r * grid.cols + c;
+			if (out.SDec) out.SDec[i] = E.SDec;
+			if (out.EOT) out.EOT[i] = E.EOT;
+			if (out.HA) out.HA[i] = P.HA;
+			if (out.SZA) out.SZA[i] = P.SZA;
+			if (out.SEA) out.SEA[i] = P.SEA;
+			if (out.AAR) out.AAR[i] = P.AAR;
+			if (out.SEC_Corr) out.SEC_Corr[i] = P.SEC_Corr;
+			if (out.SAA) out.SAA[i] = P.SAA;
+			if (daylight) daylight[i] = P.SEA > SOLAR_HORIZON;
+		}
+	}
+}
+
+// Grid rows [begin, end) of a raster, as a job for solarParallel()
+struct SolarRasterJob {
+	const SolarEphemeris *E;
+	const SolarGrid *grid;
+	const SolarBatchOut *out;
+	uint8_t *daylight;
+	void operator()(size_t begin, size_t end) const {
+		runSolarRaster(*E, *grid, begin, end, *out, daylight);
+	}
+};
+
+// The ephemeris is worked out once, then the grid rows are split over the
+// worker threads, if any, in whole bands of tiles
+void calcSolarRaster(int64_t utcMillis, const SolarGrid &grid,
+		const SolarBatchOut &out, uint8_t *daylight){
+	SolarEphemeris E;
+	calcSolarEphemerisMillis(utcMillis, E);
+	SolarRasterJob job = { &E, &grid, &out, daylight };
+	solarParallel(grid.rows, grid.cols, SOLAR_RASTER_GRAIN, job);
+}
+void calcSolarRaster(int64_t utcMillis, const SolarGrid &grid,
+		SolarColumns &cols, uint8_t *daylight){
+	SolarGrid g = grid;
+	if (g.cols == 0) return;
+	if (g.rows > cols.size() / g.cols) g.rows = cols.size() / g.cols;
+	calcSolarRaster(utcMillis, g, cols.out(), daylight);
+}
+
+// Number of threads the batch functions use: as requested, or one per core
+// when not set or when the number of cores is unknown
+unsigned int getSolarThreads(){
+#if defined(SOLARLIB_THREADS)
+	if (solarThreads) return solarThreads;
+	unsigned int cores = std::thread::hardware_concurrency();
+	return cores ? cores : 1;
+#else
+	return 1;
+#endif
+}
+void setSolarThreads(unsigned int n){
+	solarThreads = n;
+}
+
+//----------------------------------------------------------------------------
+// SolarScheduler methods
+#define SOLAR_JOB_BATCH		0
+#define SOLAR_JOB_FLEET		1
+#define SOLAR_JOB_RASTER	2
+
+// Chunks are cut to about this estimated cost, or smaller when that would
+// leave fewer than SOLAR_CHUNKS_PER_THREAD chunks per thread to share out.
+// A unit of cost is about one fleet site: a few tens of nanoseconds.
+#define SOLAR_CHUNK_COST		65536.0
+#define SOLAR_CHUNK_MIN_COST	4096.0
+#define SOLAR_CHUNKS_PER_THREAD	8
+
+// One queued job. Its units are time values (batch), sites (fleet) or grid
+// rows (raster), and are handled in chunks of whole units.
+struct SolarSchedJob {
+	int kind;			// SOLAR_JOB_ value
+	size_t units;		// number of units
+	size_t grain;		// chunks start at a multiple of this many units
+	double unitCost;	// estimated cost of one unit
+	SolarSite site;		// batch: the site
+	const SolarChebyshev *fit;	// batch: the ephemeris fit, or null
+	const int64_t *t;	// batch: the time values
+	const SolarSiteRegistry *sites;	// fleet: the sites
+	SolarGrid grid;		// raster: the grid
+	SolarEphemeris E;	// fleet and raster: the instant
+	SolarBatchOut out;
+	uint8_t *daylight;	// raster: day/night flags, or null
+};
+
+// Run units [begin, end) of a job
+static void runSolarChunk(const SolarSchedJob &job, size_t begin,
+		size_t end){
+	if (job.kind == SOLAR_JOB_BATCH) {
+		SolarElements SE = SolarElements();
+		SE.tzOffset = job.site.tz;
+		SE.lat = job.site.latDeg;
+		SE.lon = job.site.lonDeg;
+		runSolarBatch(SE, job.site, job.fit, job.t + begin, end - begin,
+				solarOffsetOut(job.out, begin));
+	} else if (job.kind == SOLAR_JOB_FLEET) {
+		runSolarFleet(job.E, *job.sites, begin, end, job.out);
+	} else {
+		runSolarRaster(job.E, job.grid, begin, end, job.out, job.daylight);
+	}
+}
+
+SolarScheduler::SolarScheduler() : jobs(0), count(0), capacity(0) {
+}
+SolarScheduler::~SolarScheduler(){
+	free(jobs);
+}
+bool SolarScheduler::push(const SolarSchedJob &job){
+	// A job with no units, or none with any cost (a grid with no columns),
+	// writes nothing; queuing it would only give run() a cost of 0 to
+	// divide by
+	if (job.units == 0 || !(job.unitCost > 0)) return true;
+	if (count == capacity) {
+		size_t n = capacity ? 2 * capacity : 16;
+		SolarSchedJob *j = (SolarSchedJob *)malloc(n * sizeof(SolarSchedJob));
+		if (!j) return false;
+		if (count) memcpy(j, jobs, count * sizeof(SolarSchedJob));
+		free(jobs);
+		jobs = j;
+		capacity = n;
+	}
+	jobs[count++] = job;
+	return true;
+}
+bool SolarScheduler::addBatch(const SolarSite &site, const int64_t *t,
+		size_t n, const SolarBatchOut &out, const SolarChebyshev *fit){
+	SolarSchedJob job = SolarSchedJob();
+	job.kind = SOLAR_JOB_BATCH;
+	job.units = n;
+	job.grain = SOLAR_BLOCK;
+	// A time value costs an ephemeris and a position; per-day values alone
+	// are far cheaper
+	bool position = out.SDec || out.EOT || out.HA || out.SZA || out.SEA ||
+					out.AAR || out.SEC_Corr || out.SAA;
+	job.unitCost = position ? 3 : 0.25;
+	job.site = site;
+	job.fit = fit;
+	job.t = t;
+	job.out = out;
+	return push(job);
+}
+bool SolarScheduler::addFleet(int64_t utcMillis,
+		const SolarSiteRegistry &sites, const SolarBatchOut &out){
+	SolarSchedJob job = SolarSchedJob();
+	job.kind = SOLAR_JOB_FLEET;
+	job.units = sites.size();
+	job.grain = SOLAR_BLOCK;
+	job.unitCost = 1;
+	job.sites = &sites;
+	calcSolarEphemerisMillis(utcMillis, job.E);
+	job.out = out;
+	return push(job);
+}
+bool SolarScheduler::addRaster(int64_t utcMillis, const SolarGrid &grid,
+		const SolarBatchOut &out, uint8_t *daylight){
+	SolarSchedJob job = SolarSchedJob();
+	job.kind = SOLAR_JOB_RASTER;
+	job.units = grid.rows;
+	job.grain = SOLAR_TILE_ROWS;
+	job.unitCost = (double)grid.cols;
+	job.grid = grid;
+	calcSolarEphemerisMillis(utcMillis, job.E);
+	job.out = out;
+	job.daylight = daylight;
+	return push(job);
+}
+
+#if defined(SOLARLIB_THREADS)
+// A piece of a job, units [begin, end)
+struct SolarChunk {
+	size_t job;
+	size_t begin;
+	size_t end;
+};
+
+// A worker's chunks. The worker takes from the back; others steal from the
+// front, so a thief gets the chunk its owner would have reached last.
+struct SolarWorkerQueue {
+	std::mutex lock;
+	std::deque<SolarChunk> chunks;
+};
+
+// Take the next chunk for worker self: its own newest, else the oldest of
+// the first other worker that has any. Chunks are all queued before the
+// workers start, so once every queue is empty there is nothing left to do.
+static bool solarTakeChunk(std::vector<SolarWorkerQueue> &queues,
+		size_t self, SolarChunk &chunk){
+	{
+		SolarWorkerQueue &own = queues[self];
+		std::lock_guard<std::mutex> hold(own.lock);
+		if (!own.chunks.empty()) {
+			chunk = own.chunks.back();
+			own.chunks.pop_back();
+			return true;
+		}
+	}
+	for (size_t k = 1; k < queues.size(); k++) {
+		SolarWorkerQueue &victim = queues[(self + k) % queues.size()];
+		std::lock_guard<std::mutex> hold(victim.lock);
+		if (!victim.chunks.empty()) {
+			chunk = victim.chunks.front();
+			victim.chunks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+static void solarWorker(const SolarSchedJob *jobs,
+		std::vector<SolarWorkerQueue> *queues, size_t self){
+	SolarChunk chunk;
+	while (solarTakeChunk(*queues, self, chunk)) {
+		runSolarChunk(jobs[chunk.job], chunk.begin, chunk.end);
+	}
+}
+#endif
+
+void SolarScheduler::run(){
+	unsigned int threads = getSolarThreads();
+#if defined(SOLARLIB_THREADS)
+	if (threads > 1) {
+		// Aim for several chunks per thread, so there is something left to
+		// steal when a worker finishes early, without making chunks so small
+		// that taking them costs more than running them
+		double total = 0;
+		for (size_t j = 0; j < count; j++) {
+			total += jobs[j].units * jobs[j].unitCost;
+		}
+		double target = total / (threads * SOLAR_CHUNKS_PER_THREAD);
+		if (target > SOLAR_CHUNK_COST) target = SOLAR_CHUNK_COST;
+		if (target < SOLAR_CHUNK_MIN_COST) target = SOLAR_CHUNK_MIN_COST;
+		// Cut the jobs and deal the chunks out in turn
+		std::vector<SolarWorkerQueue> queues(threads);
+		size_t next = 0;
+		for (size_t j = 0; j < count; j++) {
+			const SolarSchedJob &job = jobs[j];
+			size_t grains = (size_t)(target / (job.unitCost * job.grain));
+			size_t step = (grains ? grains : 1) * job.grain;
+			for (size_t begin = 0; begin < job.units; begin += step) {
+				size_t end = begin + step < job.units ? begin + step : job.units;
+				SolarChunk chunk = { j, begin, end };
+				queues[next++ % threads].chunks.push_back(chunk);
+			}
+		}
+		std::vector<std::thread> workers;
+		workers.reserve(threads - 1);
+		for (size_t k = 1; k < threads; k++) {
+			workers.push_back(std::thread(solarWorker, jobs, &queues, k));
+		}
+		solarWorker(jobs, &queues, 0);
+		for (size_t k = 0; k < workers.size(); k++) workers[k].join();
+		count = 0;
+		return;
+	}
+#endif
+	(void)threads;
+	for (size_t j = 0; j < count; j++) {
+		runSolarChunk(jobs[j], 0, jobs[j].units);
+	}
+	count = 0;
+}
+
+//----------------------------------------------------------------------------
+// SolarSweep methods
+SolarSweep::SolarSweep(const SolarSite &site, int64_t start, int64_t end,
+		int64_t step, unsigned int refresh, const SolarChebyshev *fit)
+		: site(site), fit(fit), t(start), end(end), step(step > 0 ? step : 1),
+		  refresh(refresh ? refresh : 1), left(0), aheadValid(false),
+		  stepMinutes((double)this->step / 60000), haV(0), dHa(0), sinHa(0),
+		  cosHa(1), sinDHa(0), cosDHa(1), decV(0), dDec(0), sinDec(0),
+		  cosDec(1), sinDDec(0), cosDDec(1), eotV(0), dEot(0) {
+	ahead = SolarEphemeris();
+	// The straight line between two ephemeris calculations is only close
+	// over a short span
+	int64_t most = SOLAR_SWEEP_SPAN / this->step;
+	if (most < 1) most = 1;
+	if (this->refresh > most) this->refresh = (unsigned int)most;
+}
+
+// The ephemeris at a local time, as calcSolarMillis() works it out, or
+// from the sweep's fit
+void SolarSweep::ephemerisAt(int64_t ms, SolarEphemeris &E) const {
+	if (fit && fit->eval(ms - site.tz * 3600000LL, E)) return;
+	long days = 0, msOfDay = 0;
+	solarSplitMillis(ms, days, msOfDay);
+	solarEphemerisAt<double, SolarLibm<double> >(days,
+			(double)msOfDay / 60000 - 60 * site.tz, E);
+}
+
+// Start a run of refresh steps. The ephemeris is worked out here and at the
+// start of the next run, and the declination and equation of time are made
+// to move in equal steps between the two. The next run reuses the second
+// ephemeris, so it costs one ephemeris per run.
+void SolarSweep::anchor(){
+	const double D2R = DEG_TO_RAD;
+	SolarEphemeris now;
+	if (aheadValid) now = ahead;
+	else ephemerisAt(t, now);
+	ephemerisAt(t + (int64_t)refresh * step, ahead);
+	aheadValid = true;
+	decV = now.SDec;
+	dDec = (ahead.SDec - now.SDec) / refresh;
+	eotV = now.EOT;
+	dEot = (ahead.EOT - now.EOT) / refresh;
+	// True Solar Time (minutes) and Hour Angle (degrees), as calcSolar()
+	double TST = now.utcMinutes + now.EOT + site.lonMinutes();
+	TST = TST - 1440 * floor(TST / 1440);
+	haV = TST / 4 - 180;
+	dHa = (stepMinutes + dEot) / 4;
+	sinHa = sin(haV * D2R);
+	cosHa = cos(haV * D2R);
+	sinDHa = sin(dHa * D2R);
+	cosDHa = cos(dHa * D2R);
+	sinDec = sin(decV * D2R);
+	cosDec = cos(decV * D2R);
+	sinDDec = sin(dDec * D2R);
+	cosDDec = cos(dDec * D2R);
+	left = refresh;
+}
+
+bool SolarSweep::next(SolarPosition &P){
+	if (t > end) return false;
+	if (left == 0) anchor();
+	const double R2D = RAD_TO_DEG;
+	const double sinLat = site.sinLat();
+	const double cosLat = site.cosLat();
+	// Hour Angle (degrees) and True Solar Time (minutes)
+	P.HA = haV;
+	P.TST = 4 * (haV + 180);
+	// Solar Zenith and Elevation Angle (degrees). The sine and cosine of the
+	// zenith angle come straight from its cosine.
+	double cosZ = sinLat * sinDec + cosLat * cosDec * cosHa;
+	if (cosZ > 1) cosZ = 1;
+	if (cosZ < -1) cosZ = -1;
+	double sinZ = sqrt(1 - cosZ * cosZ);
+	P.SZA = acos(cosZ) * R2D;
+	P.SEA = 90 - P.SZA;
+	// Approximate Atmospheric Refraction (degrees), with 1 / tan(SEA) as
+	// sin(SZA) / cos(SZA)
+	P.AAR = solarRefraction<double, SolarLibm<double> >(P.SEA,
+														 sinZ / cosZ) / 3600;
+	P.SEC_Corr = P.SEA + P.AAR;
+	// Solar Azimuth Angle (degrees clockwise from North)
+	P.SAA = solarAzimuth<double, SolarLibm<double> >(sinHa, cosHa, sinDec,
+													 cosDec, sinLat, cosLat);
+	// Step the hour angle and declination, and their sines and cosines
+	haV += dHa;
+	if (haV >= 180) haV -= 360 * floor((haV + 180) / 360);
+	double s = sinHa * cosDHa + cosHa * sinDHa;
+	cosHa = cosHa * cosDHa - sinHa * sinDHa;
+	sinHa = s;
+	decV += dDec;
+	s = sinDec * cosDDec + cosDec * sinDDec;
+	cosDec = cosDec * cosDDec - sinDec * sinDDec;
+	sinDec = s;
+	eotV += dEot;
+	t += step;
+	left--;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// SolarChebyshev methods
+
+// Values fitted per segment, in the order they are stored
+#define SOLAR_CHEB_SDEC		0
+#define SOLAR_CHEB_EOT		1
+#define SOLAR_CHEB_SRV		2
+#define SOLAR_CHEB_VALUES	3
+
+SolarChebyshev::SolarChebyshev() : coef(0), first(0), last(-1) {
+}
+SolarChebyshev::~SolarChebyshev(){
+	release();
+}
+
+// Each segment is sampled at the N Chebyshev nodes x_j = cos(pi (j + 1/2) / N)
+// of its span mapped to -1..1, and the terms found from the samples with
+// c_k = 2/N sum_j f(x_j) T_k(x_j). The series then matches the full
+// calculation exactly at the nodes, and within about the size of the first
+// term left out everywhere else.
+bool SolarChebyshev::fit(long firstDay, long lastDay){
+	const double pi = 3.14159265358979323846;
+	const int N = SOLAR_CHEB_TERMS;
+	release();
+	if (lastDay < firstDay) return false;
+	size_t segments = (size_t)((lastDay - firstDay) / SOLAR_CHEB_DAYS) + 1;
+	coef = (double *)malloc(segments * SOLAR_CHEB_VALUES * N * sizeof(double));
+	if (!coef) return false;
+	first = firstDay;
+	last = lastDay;
+	// T_k(x_j) is cos(pi k (j + 1/2) / N)
+	double Tkj[SOLAR_CHEB_TERMS][SOLAR_CHEB_TERMS];
+	for (int k = 0; k < N; k++) {
+		for (int j = 0; j < N; j++) Tkj[k][j] = cos(pi * k * (j + 0.5) / N);
+	}
+	for (size_t s = 0; s < segments; s++) {
+		long day0 = firstDay + (long)s * SOLAR_CHEB_DAYS;
+		double f[SOLAR_CHEB_VALUES][SOLAR_CHEB_TERMS];
+		for (int j = 0; j < N; j++) {
+			// Days into the segment
+			double u = SOLAR_CHEB_DAYS * (1 + Tkj[1][j]) / 2;
+			long d = (long)floor(u);
+			SolarEphemeris E;
+			solarEphemerisAt<double, SolarLibm<double> >(day0 + d,
+					(u - d) * 1440, E);
+			f[SOLAR_CHEB_SDEC][j] = E.SDec;
+			f[SOLAR_CHEB_EOT][j] = E.EOT;
+			f[SOLAR_CHEB_SRV][j] = E.SRV;
+		}
+		double *c = coef + s * SOLAR_CHEB_VALUES * N;
+		for (int v = 0; v < SOLAR_CHEB_VALUES; v++) {
+			for (int k = 0; k < N; k++) {
+				double sum = 0;
+				for (int j = 0; j < N; j++) sum += f[v][j] * Tkj[k][j];
+				c[v * N + k] = 2 * sum / N;
+			}
+			// Halve the first term so eval() is a plain sum
+			c[v * N] /= 2;
+		}
+	}
+	return true;
+}
+
+void SolarChebyshev::release(){
+	free(coef);
+	coef = 0;
+	first = 0;
+	last = -1;
+}
+
+bool SolarChebyshev::covers(int64_t utcMillis) const {
+	long days = 0, msOfDay = 0;
+	solarSplitMillis(utcMillis, days, msOfDay);
+	return coef && days >= first && days <= last;
+}
+
+// Sum of c_k T_k(x) by Clenshaw's recurrence
+static double solarChebSum(const double *c, double x){
+	double b1 = 0, b2 = 0;
+	for (int k = SOLAR_CHEB_TERMS - 1; k > 0; k--) {
+		double b = 2 * x * b1 - b2 + c[k];
+		b2 = b1;
+		b1 = b;
+	}
+	return x * b1 - b2 + c[0];
+}
+
+bool SolarChebyshev::eval(int64_t utcMillis, SolarEphemeris &E) const {
+	const int N = SOLAR_CHEB_TERMS;
+	long days = 0, msOfDay = 0;
+	solarSplitMillis(utcMillis, days, msOfDay);
+	if (!coef || days < first || days > last) return false;
+	long s = (days - first) / SOLAR_CHEB_DAYS;
+	double utcMinutes = (double)msOfDay / 60000;
+	// Position in the segment, -1 to 1
+	double u = (days - first - s * SOLAR_CHEB_DAYS) + utcMinutes / 1440;
+	double x = 2 * u / SOLAR_CHEB_DAYS - 1;
+	const double *c = coef + (size_t)s * SOLAR_CHEB_VALUES * N;
+	E.utcMinutes = utcMinutes;
+	E.JDN = julianUnixEpoch + days + utcMinutes / 1440;
+	E.JCN = ((double)(days - 10957) + (utcMinutes / 1440 - 0.5)) / 36525;
+	E.SDec = solarChebSum(c + SOLAR_CHEB_SDEC * N, x);
+	E.EOT = solarChebSum(c + SOLAR_CHEB_EOT * N, x);
+	E.SRV = solarChebSum(c + SOLAR_CHEB_SRV * N, x);
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// SolarEphemerisFile methods
+SolarEphemerisFile::SolarEphemerisFile()
+		: records(0), first(0), count(0), map(0), mapBytes(0), gen(0) {
+}
+SolarEphemerisFile::~SolarEphemerisFile(){
+	close();
+}
+
+// Check the header and point at the records in place. The records are
+// doubles in this machine's byte order, so they must be 8-byte aligned.
+bool SolarEphemerisFile::attach(const void *data, size_t bytes){
+	close();
+	if (!data || bytes < sizeof(SolarTableHeader)) return false;
+	if ((uintptr_t)data % sizeof(double) != 0) return false;
+	const SolarTableHeader *h = (const SolarTableHeader *)data;
+	if (memcmp(h->magic, SOLAR_TABLE_MAGIC, sizeof(h->magic)) != 0) {
+		return false;
+	}
+	// Written on a machine of the other byte order
+	if (h->endian != SOLAR_TABLE_ENDIAN) return false;
+	if (h->version != SOLAR_TABLE_VERSION) return false;
+	if (h->headerSize != sizeof(SolarTableHeader) ||
+		h->recordSize != sizeof(SolarTableRecord)) return false;
+	if ((bytes - sizeof(SolarTableHeader)) / sizeof(SolarTableRecord) <
+		h->days) return false;
+	records = (const SolarTableRecord *)(h + 1);
+	first = h->firstDay;
+	count = h->days;
+	gen++;
+	return true;
+}
+
+bool SolarEphemerisFile::open(const char *path){
+	close();
+#if defined(SOLAR_HAS_MMAP)
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	void *p = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	// The mapping stays valid once the file is closed
+	::close(fd);
+	if (p == MAP_FAILED) return false;
+	if (!attach(p, (size_t)st.st_size)) {
+		munmap(p, (size_t)st.st_size);
+		return false;
+	}
+	map = p;
+	mapBytes = (size_t)st.st_size;
+	return true;
+#else
+	(void)path;
+	return false;
+#endif
+}
+
+void SolarEphemerisFile::close(){
+#if defined(SOLAR_HAS_MMAP)
+	if (map) munmap(map, mapBytes);
+#endif
+	if (records) gen++;
+	records = 0;
+	first = 0;
+	count = 0;
+	map = 0;
+	mapBytes = 0;
+}
+
+// The record for a day is at 12:00 GMT, so local noon in time zone tzOffset
+// is tzOffset / 24 of a record before it. Cubic interpolation through the
+// two records either side is within 1e-7 degree.
+bool SolarEphemerisFile::noon(long unixDays, int tzOffset, double &SDec,
+		double &EOT, double &SRV) const {
+	if (!records) return false;
+	// Records before local noon, and how far past the last of them
+	double x = (double)(unixDays - first) - (double)tzOffset / 24;
+	double fl = floor(x);
+	long i = (long)fl;
+	double f = x - fl;
+	if (i < 1 || i + 2 >= count) return false;
+	// Lagrange weights for records i - 1 to i + 2
+	double w0 = -f * (f - 1) * (f - 2) / 6;
+	double w1 = (f + 1) * (f - 1) * (f - 2) / 2;
+	double w2 = -(f + 1) * f * (f - 2) / 2;
+	double w3 = (f + 1) * f * (f - 1) / 6;
+	const SolarTableRecord *r = records + i - 1;
+	SDec = w0 * r[0].SDec + w1 * r[1].SDec + w2 * r[2].SDec + w3 * r[3].SDec;
+	EOT = w0 * r[0].EOT + w1 * r[1].EOT + w2 * r[2].EOT + w3 * r[3].EOT;
+	SRV = w0 * r[0].SRV + w1 * r[1].SRV + w2 * r[2].SRV + w3 * r[3].SRV;
+	return true;
+}
+
+// Fill in a header for days firstDay onward
+void initSolarTableHeader(SolarTableHeader &h, long firstDay,
+		unsigned long days){
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SOLAR_TABLE_MAGIC, sizeof(h.magic));
+	h.endian = SOLAR_TABLE_ENDIAN;
+	h.version = SOLAR_TABLE_VERSION;
+	h.headerSize = sizeof(SolarTableHeader);
+	h.recordSize = sizeof(SolarTableRecord);
+	h.firstDay = (int32_t)firstDay;
+	h.days = (uint32_t)days;
+}
+
+// The ephemeris at 12:00 GMT on a day
+void calcSolarTableRecord(long unixDays, SolarTableRecord &r){
+	SolarEphemeris E;
+	solarEphemerisAt<double, SolarLibm<double> >(unixDays, 720.0, E);
+	r.SDec = E.SDec;
+	r.EOT = E.EOT;
+	r.SRV = E.SRV;
+}
+
+
+//----------------------------------------------------------------------------
+// SolarColumns methods
+SolarColumns::SolarColumns() : block(0), rows(0), mask(0) {
+}
+SolarColumns::SolarColumns(size_t n, unsigned int columns)
+		: block(0), rows(0), mask(0) {
+	allocate(n, columns);
+}
+SolarColumns::~SolarColumns(){
+	release();
+}
+bool SolarColumns::allocate(size_t n, unsigned int columns){
+	release();
+	columns &= SOLAR_COL_ALL;
+	// Count the double and the time_t columns, then give each its own slice
+	// of one block. The doubles come first so every column stays aligned.
+	size_t nDouble = 0, nTime = 0;
+	for (unsigned int c = SOLAR_COL_SDEC; c <= SOLAR_COL_SAA; c <<= 1) {
+		if (columns & c) nDouble++;
+	}
+	for (unsigned int c = SOLAR_COL_NOON; c <= SOLAR_COL_SUNSET; c <<= 1) {
+		if (columns & c) nTime++;
+	}
+	// On failure release() has already left no rows and no columns
+	size_t rowBytes = nDouble * sizeof(double) + nTime * sizeof(time_t);
+	if (rowBytes && n > SIZE_MAX / rowBytes) return false;
+	size_t bytes = n * rowBytes;
+	if (bytes) {
+		block = malloc(bytes);
+		if (!block) return false;
+	}
+	// With no rows or no columns there is no block, and the columns asked
+	// for stay null
+	double *d = (double *)block;
+	if (columns & SOLAR_COL_SDEC) { cols.SDec = d; d += n; }
+	if (columns & SOLAR_COL_EOT) { cols.EOT = d; d += n; }
+	if (columns & SOLAR_COL_HA) { cols.HA = d; d += n; }
+	if (columns & SOLAR_COL_SZA) { cols.SZA = d; d += n; }
+	if (columns & SOLAR_COL_SEA) { cols.SEA = d; d += n; }
+	if (columns & SOLAR_COL_AAR) { cols.AAR = d; d += n; }
+	if (columns & SOLAR_COL_SEC_CORR) { cols.SEC_Corr = d; d += n; }
+	if (columns & SOLAR_COL_SAA) { cols.SAA = d; d += n; }
+	time_t *tm = (time_t *)d;
+	if (columns & SOLAR_COL_NOON) { cols.SolarNoonTime = tm; tm += n; }
+	if (columns & SOLAR_COL_SUNRISE) { cols.SunriseTime = tm; tm += n; }
+	if (columns & SOLAR_COL_SUNSET) { cols.SunsetTime = tm; tm += n; }
+	rows = n;
+	mask = columns;
+	return true;
+}
+void SolarColumns::release(){
+	free(block);
+	block = 0;
+	cols = SolarBatchOut();
+	rows = 0;
+	mask = 0;
+}
+
+// A handle is a slot number in its low 24 bits and the slot's generation in
+// its top 8. Removing a site bumps its slot's generation, so a handle kept
+// after removal does not match a new site given the same slot.
+#define SOLAR_SLOT_BITS		24
+#define SOLAR_SLOT_MASK		0x00FFFFFFUL
+#define SOLAR_MAX_SITES		0x00FFFFFFUL
+
+SolarSiteRegistry::SolarSiteRegistry()
+		: block(0), count(0), capacity(0), latDeg(0), lonDeg(0), sinLatV(0),
+		  cosLatV(0), lonMin(0), tz(0), handles(0), slotRow(0), slotGen(0),
+		  slots(0), freeSlot(SOLAR_NO_SITE) {
+}
+SolarSiteRegistry::~SolarSiteRegistry(){
+	free(block);
+}
+bool SolarSiteRegistry::reserve(size_t n){
+	if (n <= capacity) return true;
+	if (n > SOLAR_MAX_SITES) return false;
+	// One block, widest type first so every array stays aligned
+	size_t bytes = n * (5 * sizeof(double) + sizeof(int) +
+						sizeof(SolarSiteHandle) + sizeof(uint32_t) +
+						sizeof(uint8_t));
+	void *b = malloc(bytes);
+	if (!b) return false;
+	double *d = (double *)b;
+	double *newLat = d; d += n;
+	double *newLon = d; d += n;
+	double *newSin = d; d += n;
+	double *newCos = d; d += n;
+	double *newLonMin = d; d += n;
+	int *newTz = (int *)d;
+	SolarSiteHandle *newHandles = (SolarSiteHandle *)(newTz + n);
+	uint32_t *newSlotRow = (uint32_t *)(newHandles + n);
+	uint8_t *newSlotGen = (uint8_t *)(newSlotRow + n);
+	if (count) {
+		memcpy(newLat, latDeg, count * sizeof(double));
+		memcpy(newLon, lonDeg, count * sizeof(double));
+		memcpy(newSin, sinLatV, count * sizeof(double));
+		memcpy(newCos, cosLatV, count * sizeof(double));
+		memcpy(newLonMin, lonMin, count * sizeof(double));
+		memcpy(newTz, tz, count * sizeof(int));
+		memcpy(newHandles, handles, count * sizeof(SolarSiteHandle));
+	}
+	if (slots) {
+		memcpy(newSlotRow, slotRow, slots * sizeof(uint32_t));
+		memcpy(newSlotGen, slotGen, slots * sizeof(uint8_t));
+	}
+	free(block);
+	block = b;
+	capacity = n;
+	latDeg = newLat;
+	lonDeg = newLon;
+	sinLatV = newSin;
+	cosLatV = newCos;
+	lonMin = newLonMin;
+	tz = newTz;
+	handles = newHandles;
+	slotRow = newSlotRow;
+	slotGen = newSlotGen;
+	return true;
+}
+SolarSiteHandle SolarSiteRegistry::add(int tzOffset, double lat, double lon){
+	if (count == capacity && !reserve(capacity ? 2 * capacity : 16)) {
+		// Doubling may overshoot the limit or the memory; try one more
+		if (!reserve(capacity + 1)) return SOLAR_NO_SITE;
+	}
+	// Reuse a free slot, or hand out a new one. There are never more slots
+	// than rows, so there is room for it.
+	uint32_t slot;
+	if (freeSlot != SOLAR_NO_SITE) {
+		slot = freeSlot;
+		freeSlot = slotRow[slot];
+	} else {
+		slot = (uint32_t)slots++;
+		slotGen[slot] = 0;
+	}
+	SolarSite site;
+	initSolarSite(site, tzOffset, lat, lon);
+	size_t row = count++;
+	latDeg[row] = site.latDeg;
+	lonDeg[row] = site.lonDeg;
+	sinLatV[row] = site.sinLatV;
+	cosLatV[row] = site.cosLatV;
+	lonMin[row] = site.lonMin;
+	tz[row] = tzOffset;
+	handles[row] = ((SolarSiteHandle)slotGen[slot] << SOLAR_SLOT_BITS) | slot;
+	slotRow[slot] = (uint32_t)row;
+	return handles[row];
+}
+long SolarSiteRegistry::indexOf(SolarSiteHandle h) const {
+	uint32_t slot = h & SOLAR_SLOT_MASK;
+	if (slot >= slots) return -1;
+	uint32_t row = slotRow[slot];
+	// A free slot's row is the next free slot, so check the row's handle
+	if (row >= count || handles[row] != h) return -1;
+	return (long)row;
+}
+bool SolarSiteRegistry::contains(SolarSiteHandle h) const {
+	return indexOf(h) >= 0;
+}
+bool SolarSiteRegistry::remove(SolarSiteHandle h){
+	long row = indexOf(h);
+	if (row < 0) return false;
+	// Move the last row into the gap to keep the arrays packed
+	size_t last = count - 1;
+	if ((size_t)row != last) {
+		latDeg[row] = latDeg[last];
+		lonDeg[row] = lonDeg[last];
+		sinLatV[row] = sinLatV[last];
+		cosLatV[row] = cosLatV[last];
+		lonMin[row] = lonMin[last];
+		tz[row] = tz[last];
+		handles[row] = handles[last];
+		slotRow[handles[row] & SOLAR_SLOT_MASK] = (uint32_t)row;
+	}
+	count--;
+	uint32_t slot = h & SOLAR_SLOT_MASK;
+	slotGen[slot]++;
+	slotRow[slot] = freeSlot;
+	freeSlot = slot;
+	return true;
+}
+void SolarSiteRegistry::clear(){
+	while (count) remove(handles[count - 1]);
+}
+
+// Each calculation stage and the stages whose results it reads. A stage always
+// has a larger flag value than anything it depends on.
+static const unsigned int solarStageDeps[][2] = {
+    { SOLAR_MEAN,        SOLAR_TIME },
+    { SOLAR_CENTER,      SOLAR_MEAN },
+    { SOLAR_OBLIQUITY,   SOLAR_CENTER },
+    { SOLAR_DECLINATION, SOLAR_OBLIQUITY },
+    { SOLAR_EOT,         SOLAR_MEAN | SOLAR_OBLIQUITY },
+    { SOLAR_NOON,        SOLAR_TIME },
+    { SOLAR_RISESET,     SOLAR_TIME },
+    { SOLAR_HOURANGLE,   SOLAR_TIME | SOLAR_EOT },
+    { SOLAR_ZENITH,      SOLAR_HOURANGLE | SOLAR_DECLINATION },
+    { SOLAR_REFRACTION,  SOLAR_ZENITH },
+    { SOLAR_AZIMUTH,     SOLAR_HOURANGLE | SOLAR_DECLINATION }
+};
+
+// Add every stage needed to produce the stages in mask. Working from the
+// last stage back to the first picks up dependencies of dependencies.
+unsigned int solarResolveMask(unsigned int mask){
+    mask &= SOLAR_ALL;
+    for (int i = sizeof(solarStageDeps)/sizeof(solarStageDeps[0]) - 1;
+         i >= 0; i--) {
+        if (mask & solarStageDeps[i][0]) {
+            mask |= solarStageDeps[i][1];
+        }
+    }
+    return mask;
+}
+
 // Main function to calculate solar values. Requires a time value (seconds since
 // 1970-1-1) as input. 
-void calcSolar(time_t t, SolarElements &SE){
-    // Calculate the time past midnight, as a fractional day value
-	// e.g. if it's noon, the result should be 0.5.
-	SE.timeFracDay = ((((double)(second(t)/60) + minute(t))/60) +
-                   hour(t))/24;
-    // unixDays is the number of whole days since the start
-    // of the Unix epoch. The division sign will truncate any remainder
-    // since this will be done as integer division.
-    SE.unixDays = t / 86400;
-    // calculate Julian Day Number
-    SE.JDN = julianUnixEpoch + SE.unixDays;
-    // Add the fractional day value to the Julian Day number. If the
-    // input value was in the GMT time zone, we could proceed directly
-    // with this value. 
-    SE.JDN = SE.JDN + SE.timeFracDay;
-    // Adjust JDN to GMT time zone
-    SE.JDN = SE.JDN - ((double)SE.tzOffset / 24);
-    // Calculate Julian Century Number
-    SE.JCN = (SE.JDN - 2451545) / 36525;
-    // Geometric Mean Longitude of Sun (degrees)
-    SE.GMLS = (280.46646 + SE.JCN * (36000.76983 + SE.JCN * 0.0003032));
-    // Finish GMLS calculation by calculating modolu(GMLS,360) as
-    // it's done in R or Excel. C's fmod doesn't work in the same
-    // way. The floor() function is from the math.h library.
-    SE.GMLS = SE.GMLS - (360 * (floor(SE.GMLS/360)) );
-    // Geometric Mean Anomaly of Sun (degrees)
-    SE.GMAS = 357.52911 + (SE.JCN * (35999.05029 - 0.0001537 * SE.JCN));
-    
-    // Eccentricity of Earth Orbit
-    SE.EEO = 0.016708634 - (SE.JCN * (0.000042037 + 0.0000001267 * SE.JCN));
-    // Sun Equation of Center
-    SE.SEC = sin(SE.GMAS * DEG_TO_RAD) * (1.914602 -
-                                    (SE.JCN * (0.004817 + 0.000014 * SE.JCN))) +
-    sin((2*SE.GMAS)* DEG_TO_RAD)*(0.019993-0.000101*SE.JCN) +
-    sin((3*SE.GMAS)* DEG_TO_RAD) * 0.000289;
-    // Sun True Longitude (degrees)
-    SE.STL = SE.GMLS + SE.SEC;
-    // Sun True Anomaly (degrees)
-    SE.STA = SE.GMAS + SE.SEC;
-    // Sun Radian Vector (Astronomical Units)
-    SE.SRV = (1.000001018 * (1- SE.EEO * SE.EEO))/(1 + SE.EEO *
-                                          cos(SE.STA * DEG_TO_RAD));
-    // Sun Apparent Longitude (degrees)
-    SE.SAL = SE.STL - 0.00569 - (0.00478 *
-                           sin((125.04 - 1934.136 * SE.JCN) * DEG_TO_RAD));
-    // Mean Oblique Ecliptic (degrees)
-    SE.MOE = 23 + (26 + (21.448-SE.JCN * ( 46.815 + SE.JCN *
-                                    (0.00059 - SE.JCN * 0.001813)))/60)/60;
-    // Oblique correction (degrees)
-    SE.OC = SE.MOE + 0.00256 * cos((125.04-1934.136*SE.JCN)*DEG_TO_RAD);
-    // Sun Right Ascension (degrees)
-    SE.SRA = (atan2(cos(SE.OC * DEG_TO_RAD) * sin(SE.SAL * DEG_TO_RAD),
-                 cos(SE.SAL * DEG_TO_RAD))) * RAD_TO_DEG;
-    // Sun Declination (degrees)
-    SE.SDec = (asin(sin(SE.OC * DEG_TO_RAD) *
-                 sin(SE.SAL * DEG_TO_RAD))) * RAD_TO_DEG;
-    // var y
-    SE.vy = tan((SE.OC/2) * DEG_TO_RAD) * tan((SE.OC/2) * DEG_TO_RAD);
-    
-    // Equation of Time (minutes)
-    SE.EOT = 4 * ((SE.vy * sin(2 * (SE.GMLS * DEG_TO_RAD)) -
-                2 * SE.EEO * sin(SE.GMAS * DEG_TO_RAD) +
-                4 * SE.EEO * SE.vy * sin(SE.GMAS * DEG_TO_RAD) * 
-                cos(2*(SE.GMLS*DEG_TO_RAD)) -
-                0.5 * SE.vy * SE.vy * sin(4*(SE.GMLS * DEG_TO_RAD)) -
-                1.25 * SE.EEO * SE.EEO * sin(2*(SE.GMAS* DEG_TO_RAD))) * 
-                RAD_TO_DEG);
-    // Hour Angle Sunrise (degrees)
-    SE.HAS = acos((cos(90.833*DEG_TO_RAD)/
-                (cos(SE.lat*DEG_TO_RAD) * cos(SE.SDec*DEG_TO_RAD))) -
-               tan(SE.lat * DEG_TO_RAD) * tan(SE.SDec * DEG_TO_RAD)) * 
-               RAD_TO_DEG ;
-    // Solar Noon - result is given as fraction of a day
-    // Time value is in GMT time zone
-    SE.SolarNoonfrac = (720 - 4 * SE.lon - SE.EOT) / 1440 ;
-    // SolarNoon is given as a fraction of a day. Add this
-    // to the unixDays value, which currently holds the
-    // whole days since 1970-1-1 00:00
-    SE.SolarNoonDays = SE.unixDays + SE.SolarNoonfrac;
-    // SolarNoonDays is in GMT time zone, correct it to
-    // the input time zone
-    SE.SolarNoonDays = SE.SolarNoonDays + ((double)SE.tzOffset / 24);
-    // Then convert SolarNoonDays to seconds
-    SE.SolarNoonTime = SE.SolarNoonDays * 86400;
-    // Sunrise Time, given as fraction of a day
-    SE.Sunrise = SE.SolarNoonfrac - SE.HAS * 4/1440;
-    // Convert Sunrise to days since 1970-1-1
-    SE.Sunrise = SE.unixDays + SE.Sunrise;
-    // Correct Sunrise to local time zone from GMT
-    SE.Sunrise = SE.Sunrise + ((double)SE.tzOffset / 24);
-    // Convert Sunrise to seconds since 1970-1-1
-    SE.Sunrise = SE.Sunrise * 86400;
-    // Convert Sunrise to a time_t object (Time library)
-    SE.SunriseTime = (time_t)SE.Sunrise;
-    // Sunset Time
-    SE.Sunset = SE.SolarNoonfrac + SE.HAS * 4/1440;
-    // Convert Sunset to days since 1970-1-1
-    SE.Sunset = SE.unixDays + SE.Sunset;
-    // Correct Sunset to local time zone from GMT
-    SE.Sunset = SE.Sunset + ((double)SE.tzOffset / 24);
-    // Convert Sunset to seconds since 1970-1-1
-    SE.Sunset = SE.Sunset * 86400;
-    // Convert Sunset to a time_t object (Time library)
-    SE.SunsetTime = (time_t)SE.Sunset;
-    // Sunlight Duration (day length, minutes)
-    SE.SunDuration = 8 * SE.HAS;
-    // True Solar Time (minutes)
-    SE.TST = (SE.timeFracDay * 1440 +
-           SE.EOT + 4 * SE.lon - 60 * SE.tzOffset);
-    // Finish TST calculation by calculating modolu(TST,360) as
-    // it's done in R or Excel. C's fmod doesn't work in the same
-    // way. The floor() function is from the math.h library.
-    SE.TST = SE.TST - (1440 * (floor(SE.TST/1440)) );
-    // Hour Angle (degrees)
-    if (SE.TST/4 < 0) {
-        SE.HA = SE.TST/4 + 180;
-    } else if (SE.TST/4 >= 0) {
-        SE.HA = SE.TST/4 - 180;
-    }
-    // Solar Zenith Angle (degrees)
-    SE.SZA = (acos(sin(SE.lat * DEG_TO_RAD) *
-                sin(SE.SDec* DEG_TO_RAD) +
-                cos(SE.lat * DEG_TO_RAD) *
-                cos(SE.SDec * DEG_TO_RAD) *
-                cos(SE.HA * DEG_TO_RAD))) * RAD_TO_DEG;
-    // Solar Elevation Angle (degrees above horizontal)
-    SE.SEA = 90 - SE.SZA;
-    // Approximate Atmospheric Refraction (degrees)
-    if (SE.SEA > 85) {
-        SE.AAR = 0;
-    } else if (SE.SEA > 5) {
-        SE.AAR = (58.1 / tan(SE.SEA * DEG_TO_RAD)) -
-        0.07 / (pow(tan(SE.SEA * DEG_TO_RAD),3)) +
-        0.000086 / (pow(tan(SE.SEA * DEG_TO_RAD),5));
-    } else if (SE.SEA > -0.575) {
-        SE.AAR = 1735 + SE.SEA * (-581.2 + SE.SEA *
-                            (103.4 + SE.SEA * (-12.79 + SE.SEA * 0.711)));
-    } else {
-        SE.AAR = -20.772 / tan(SE.SEA * DEG_TO_RAD);
-    }
-    SE.AAR = SE.AAR / 3600.0;
-    // Solar Elevation Corrected for Atmospheric
-    // refraction (degrees)
-    SE.SEC_Corr = SE.SEA + SE.AAR;
-    // Solar Azimuth Angle (degrees clockwise from North)
-    if (SE.HA > 0) {
-        SE.SAA = (((acos((sin(SE.lat * DEG_TO_RAD) *
-                       cos(SE.SZA * DEG_TO_RAD) -
-                       sin(SE.SDec * DEG_TO_RAD)) /
-                      (cos(SE.lat * DEG_TO_RAD) *
-                       sin(SE.SZA * DEG_TO_RAD))) ) *
-                RAD_TO_DEG) + 180);
-        SE.SAA = SE.SAA - (360 * (floor(SE.SAA/360)));
-    } else {
-        SE.SAA = (540 - (acos((((sin(SE.lat * DEG_TO_RAD) *
-                              cos(SE.SZA * DEG_TO_RAD))) -
-                            sin(SE.SDec * DEG_TO_RAD)) /
-                           (cos(SE.lat * DEG_TO_RAD) *
-                            sin(SE.SZA * DEG_TO_RAD)))) *
-               RAD_TO_DEG);
-        SE.SAA = SE.SAA - (360 * (floor(SE.SAA/360)));
+template <typename T>
+void calcSolar(time_t t, SolarElementsT<T> &SE){
+    runSolarStages(t, SE, SOLAR_ALL);
+}
+
+// Calculate only the stages needed for the fields named in mask
+template <typename T>
+void calcSolar(time_t t, SolarElementsT<T> &SE, unsigned int mask){
+    runSolarStages(t, SE, solarResolveMask(mask));
+}
+
+// Work out the values that depend only on the site. The trig is done once
+// here, so it is always the full tier's.
+template <typename T>
+void initSolarSite(SolarSiteT<T> &site, int tzOffset, double lat, double lon,
+                   int tier){
+    typedef SolarLibm<T> M;
+    const T D2R = T(DEG_TO_RAD);
+    site.tz = tzOffset;
+    site.latDeg = (T)lat;
+    site.lonDeg = (T)lon;
+    site.sinLatV = M::sin(site.latDeg * D2R);
+    site.cosLatV = M::cos(site.latDeg * D2R);
+    site.tanLatV = M::tan(site.latDeg * D2R);
+    site.lonMin = 4 * site.lonDeg;
+    site.tzDaysV = (T)tzOffset / 24;
+    site.cosHorizonV = M::cos(T(90.833) * D2R);
+    site.tier = (tier == SOLAR_TIER_FINE || tier == SOLAR_TIER_COARSE) ?
+                tier : SOLAR_TIER_FULL;
+    site.file = 0;
+}
+
+// calcSolar() for a time in milliseconds since 1970-1-1, local time zone
+template <typename T>
+void calcSolarMillis(int64_t ms, SolarElementsT<T> &SE, unsigned int mask){
+    long days = 0, msOfDay = 0;
+    solarSplitMillis(ms, days, msOfDay);
+    runSolarStagesAt(days, (T)msOfDay / 86400000, SE, solarResolveMask(mask));
+}
+
+// The same for a prepared site, at its tier
+template <typename T>
+void calcSolarMillis(int64_t ms, const SolarSiteT<T> &site,
+                     SolarElementsT<T> &SE, unsigned int mask){
+    long days = 0, msOfDay = 0;
+    solarSplitMillis(ms, days, msOfDay);
+    SE.tzOffset = site.tz;
+    SE.lat = site.latDeg;
+    SE.lon = site.lonDeg;
+    runSolarStagesAt(days, (T)msOfDay / 86400000, site, SE,
+                     solarResolveMask(mask));
+}
+
+// calcSolar() for a time in seconds since 1970-1-1, local time zone, with a
+// fractional part
+template <typename T>
+void calcSolarUnix(double seconds, SolarElementsT<T> &SE, unsigned int mask){
+    double days = floor(seconds / 86400);
+    runSolarStagesAt((long)days, (T)((seconds - days * 86400) / 86400), SE,
+                     solarResolveMask(mask));
+}
+
+// calcSolar() for a time in seconds since 2000-1-1 12:00 (J2000.0), local
+// time zone. A double holds these to well under a microsecond for
+// centuries either side of 2000.
+template <typename T>
+void calcSolarJ2000(double seconds, SolarElementsT<T> &SE, unsigned int mask){
+    // Seconds since 2000-1-1 00:00, which is day 10957 of the Unix epoch
+    seconds = seconds + 43200;
+    double days = floor(seconds / 86400);
+    runSolarStagesAt(10957 + (long)days,
+                     (T)((seconds - days * 86400) / 86400), SE,
+                     solarResolveMask(mask));
+}
+
+// Calculate the site-independent part of the solar calculation for a time
+// value given in GMT.
+template <typename T>
+void calcSolarEphemeris(time_t t, SolarEphemerisT<T> &E, int tier){
+    long days = 0, secs = 0;
+    solarSplitTime(t, days, secs);
+    // Minutes past midnight GMT
+    SolarEphemerisJob<T> job = { days, (T)secs / 60, &E };
+    solarTierRun<T>(tier, job);
+}
+
+// Same as above, for a time given in milliseconds since 1970-1-1 GMT
+template <typename T>
+void calcSolarEphemerisMillis(int64_t ms, SolarEphemerisT<T> &E, int tier){
+    long days = 0, msOfDay = 0;
+    solarSplitMillis(ms, days, msOfDay);
+    SolarEphemerisJob<T> job = { days, (T)msOfDay / 60000, &E };
+    solarTierRun<T>(tier, job);
+}
+
+// Calculate the sun position for one site from a shared ephemeris
+template <typename T>
+void calcSolarPosition(const SolarEphemerisT<T> &E, double lat, double lon,
+                       SolarPositionT<T> &P){
+    SolarSiteT<T> site;
+    initSolarSite(site, 0, lat, lon);
+    calcSolarPosition(E, site, P);
+}
+
+template <typename T>
+void calcSolarPosition(const SolarEphemerisT<T> &E, const SolarSiteT<T> &site,
+                       SolarPositionT<T> &P){
+    SolarPositionJob<T, SolarPositionT<T>, SolarSiteT<T> > job = { E.SDec,
+        E.EOT, E.utcMinutes, &P, &site,
+        SOLAR_HOURANGLE | SOLAR_ZENITH | SOLAR_REFRACTION | SOLAR_AZIMUTH };
+    solarTierRun<T>(site.tier, job);
+}
+
+// Calculate the values that stay the same for a whole day. The declination
+// and equation of time used are those at local noon of the requested day.
+template <typename T>
+void calcSolarDay(long unixDays, int tzOffset, double lat, double lon,
+                  SolarDayT<T> &SD){
+    SolarSiteT<T> site;
+    initSolarSite(site, tzOffset, lat, lon);
+    calcSolarDay(unixDays, site, SD);
+}
+
+// The declination and equation of time at local noon come from the
+// site's ephemeris file if it has one and it covers the day
+template <typename T>
+void calcSolarDay(long unixDays, const SolarSiteT<T> &site, SolarDayT<T> &SD){
+    double SDec = 0, EOT = 0, SRV = 0;
+    bool given = site.file && site.file->noon(unixDays, site.tz, SDec, EOT,
+                                              SRV);
+    SolarDayJob<T, SolarSiteT<T> > job = { unixDays, &site, &SD, given,
+                                           (T)SDec, (T)EOT };
+    solarTierRun<T>(site.tier, job);
+}
+
+// Evaluate the requested stages for the site stored in SE. Dependencies are
+// not resolved here, so any stage that is skipped must already hold valid
+// results in SE.
+template <typename T>
+static void runSolarStages(time_t t, SolarElementsT<T> &SE,
+                           unsigned int stages){
+    long days = 0, secs = 0;
+    solarSplitTime(t, days, secs);
+    runSolarStagesAt(days, (T)secs / 86400, SE, stages);
+}
+
+// As above, for a time already split into a day and a fraction of a day
+template <typename T>
+static void runSolarStagesAt(long unixDays, T timeFracDay,
+                             SolarElementsT<T> &SE, unsigned int stages){
+    SolarSiteT<T> site;
+    initSolarSite(site, SE.tzOffset, SE.lat, SE.lon);
+    runSolarStagesAt(unixDays, timeFracDay, site, SE, stages);
+}
+
+// The same for a prepared site, at its tier. The per-day values go through
+// calcSolarDay(), so they come from the site's ephemeris file if it has one.
+template <typename T>
+static void runSolarStagesAt(long unixDays, T timeFracDay,
+                             const SolarSiteT<T> &site, SolarElementsT<T> &SE,
+                             unsigned int stages){
+    SolarStagesJob<T, SolarSiteT<T> > job = { unixDays, timeFracDay, &SE,
+        &site, stages & ~(SOLAR_NOON | SOLAR_RISESET) };
+    solarTierRun<T>(site.tier, job);
+    if (stages & (SOLAR_NOON | SOLAR_RISESET)) {
+        SolarDayT<T> SD;
+        calcSolarDay(unixDays, site, SD);
+        copySolarDay(SD, SE);
     }
-}
\ No newline at end of file
+}
+
+// Instantiate the engine for each supported scalar type
+#define SOLAR_INSTANTIATE(T) \
+    template void calcSolar<T>(time_t, SolarElementsT<T> &); \
+    template void calcSolar<T>(time_t, SolarElementsT<T> &, unsigned int); \
+    template void calcSolarMillis<T>(int64_t, SolarElementsT<T> &, \
+                                     unsigned int); \
+    template void calcSolarMillis<T>(int64_t, const SolarSiteT<T> &, \
+                                     SolarElementsT<T> &, unsigned int); \
+    template void calcSolarUnix<T>(double, SolarElementsT<T> &, unsigned int); \
+    template void calcSolarJ2000<T>(double, SolarElementsT<T> &, unsigned int); \
+    template void calcSolarEphemeris<T>(time_t, SolarEphemerisT<T> &, int); \
+    template void calcSolarEphemerisMillis<T>(int64_t, SolarEphemerisT<T> &, \
+                                              int); \
+    template void calcSolarPosition<T>(const SolarEphemerisT<T> &, double, \
+                                       double, SolarPositionT<T> &); \
+    template void calcSolarPosition<T>(const SolarEphemerisT<T> &, \
+                                       const SolarSiteT<T> &, \
+                                       SolarPositionT<T> &); \
+    template void calcSolarDay<T>(long, int, double, double, SolarDayT<T> &); \
+    template void calcSolarDay<T>(long, const SolarSiteT<T> &, SolarDayT<T> &); \
+    template void initSolarSite<T>(SolarSiteT<T> &, int, double, double, int);
+SOLAR_INSTANTIATE(float)
+SOLAR_INSTANTIATE(double)
+#ifdef SOLAR_HAS_LONG_DOUBLE
+SOLAR_INSTANTIATE(long double)
+#endif
@@ -49,55 +49,605 @@
 #ifndef Solarlib_h
 #define Solarlib_h
 
+#if defined(ARDUINO)
 #include "Arduino.h"
 #include "math.h"
 #include "Time.h"
+#else
+// Building on a desktop machine (for example the tools in extras/), without
+// the Arduino core or the Time library
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#ifndef DEG_TO_RAD
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+#endif
+#endif
 
 #define julianUnixEpoch  2440587.5 // julian days to start of unix epoch
 
-typedef struct {
+// Accuracy tiers for the math functions of the scalar engine, picked per
+// site with initSolarSite() or per context with SolarContext::setTier(). The
+// tolerance is for the angles calcSolar() gives, against
+// the results with the C math library; the NOAA equations themselves are
+// good to about 0.01 degree. See extras/tiers/README.md.
+#define SOLAR_TIER_FULL		0	// the C math library
+#define SOLAR_TIER_FINE		1	// polynomials, within 1e-5 degree
+#define SOLAR_TIER_COARSE	2	// polynomials, within 1e-3 degree
+
+// The solar calculation can be carried out in float, double or long double.
+// SolarElements, SolarDay, SolarEphemeris and SolarPosition are the double
+// versions; use SolarElementsT<float> etc. with calcSolar() to get the others.
+// Fields that hold an absolute time (JDN, SolarNoonDays, Sunrise, Sunset) are
+// always double, since a float cannot hold a Unix time to better than about
+// two minutes. See extras/accuracy/README.md for how far the float version
+// strays from the long double results.
+template <typename T>
+struct SolarElementsT {
 	int tzOffset;	// Time zone Offset, zones west of GMT are negative
-	double lat;		// Latitude of site, values north of equator are positive
-	double lon;		// Longitude of site, values west of GMT are negative
-    double timeFracDay;  // Fraction of day past midnight for current time
+	T lat;		// Latitude of site, values north of equator are positive
+	T lon;		// Longitude of site, values west of GMT are negative
+    T timeFracDay;  // Fraction of day past midnight for current time
     long unixDays;  // Days since 1970-1-1
     double JDN;     // Julian Day Number
-    double JCN;     // Julian Century Number
-    double GMLS;    // Geometric Mean Longitude of Sun
-    double GMAS;    // Geometric Mean Anomaly of Sun
-    double EEO;     // Eccentricity of Earth Orbit (degrees)
-    double SEC;     // Sun Equation of Center 
-    double STL;     // Sun True Longitude (degrees)
-    double STA;     // Sun True Anomaly (degrees)
-    double SRV;     // Sun Radian Vector (degrees)
-    double SAL;     // Sun Apparent Longitude 
-    double MOE;     // Mean Oblique Ecliptic (degrees)
-    double OC;      // Oblique correction 
-    double SRA;     // Sun Right Ascension (degrees)
-    double SDec;    // Sun Declination (degrees)
-    double vy;		// var y
-    double EOT;     // Equation of Time (minutes)
-    double HAS;     // Hour Angle Sunrise (degrees)
-    double SolarNoonfrac;       // Solar noon (fractional day)
+    T JCN;     // Julian Century Number
+    T GMLS;    // Geometric Mean Longitude of Sun
+    T GMAS;    // Geometric Mean Anomaly of Sun
+    T EEO;     // Eccentricity of Earth Orbit (degrees)
+    T SEC;     // Sun Equation of Center 
+    T STL;     // Sun True Longitude (degrees)
+    T STA;     // Sun True Anomaly (degrees)
+    T SRV;     // Sun Radian Vector (degrees)
+    T SAL;     // Sun Apparent Longitude 
+    T MOE;     // Mean Oblique Ecliptic (degrees)
+    T OC;      // Oblique correction 
+    T SRA;     // Sun Right Ascension (degrees)
+    T SDec;    // Sun Declination (degrees)
+    T vy;		// var y
+    T EOT;     // Equation of Time (minutes)
+    T HAS;     // Hour Angle Sunrise (degrees)
+    T SolarNoonfrac;       // Solar noon (fractional day)
+    double SolarNoonDays;   // Solar Noon (days since 1970-1-1)
+    time_t SolarNoonTime;   // Solar Noon time (Time Object)
+    double Sunrise;     // Sunrise time (unix time, seconds)
+    time_t SunriseTime; // Sunrise time (Time object)
+    double Sunset;      // Sunset times (unix time, seconds)
+    time_t SunsetTime;  // Sunset time (Time object)
+    T SunDuration; // Sunlight Duration (minutes)
+    T TST;     // True Solar Time (minutes)
+    T HA;      // Hour Angle (degrees)
+    T SZA;  // Solar Zenith Angle (degrees)
+    T SEA;     // Solar Elevation Angle (degrees)
+    T AAR;  // Approximate Atmospheric Refraction 
+    T SEC_Corr; // Solar Elevation, Corrected (degrees)
+    T SAA; // Solar Azimuth Angle (degrees)
+    int tier;  // SOLAR_TIER_ of the math the last stages were run with
+};
+typedef SolarElementsT<double> SolarElements;
+// Values that only change once per day for a given site. The declination and
+// equation of time behind them are taken at local noon of the day, so every
+// time value within a day gives the same sunrise, solar noon and sunset.
+template <typename T>
+struct SolarDayT {
+    long unixDays;  // Days since 1970-1-1 these values belong to
+    T HAS;     // Hour Angle Sunrise (degrees)
+    T SolarNoonfrac;       // Solar noon (fractional day)
     double SolarNoonDays;   // Solar Noon (days since 1970-1-1)
     time_t SolarNoonTime;   // Solar Noon time (Time Object)
     double Sunrise;     // Sunrise time (unix time, seconds)
     time_t SunriseTime; // Sunrise time (Time object)
     double Sunset;      // Sunset times (unix time, seconds)
     time_t SunsetTime;  // Sunset time (Time object)
-    double SunDuration; // Sunlight Duration (minutes)
-    double TST;     // True Solar Time (minutes)
-    double HA;      // Hour Angle (degrees)
-    double SZA;  // Solar Zenith Angle (degrees)
-    double SEA;     // Solar Elevation Angle (degrees)
-    double AAR;  // Approximate Atmospheric Refraction 
-    double SEC_Corr; // Solar Elevation, Corrected (degrees)
-    double SAA; // Solar Azimuth Angle (degrees)
-} SolarElements;
+    T SunDuration; // Sunlight Duration (minutes)
+    int tier;  // SOLAR_TIER_ of the math these were worked out with
+};
+typedef SolarDayT<double> SolarDay;
+// The part of the calculation that depends only on time, not on the site.
+// One SolarEphemeris can be shared by any number of sites at the same instant
+// using calcSolarPosition().
+template <typename T>
+struct SolarEphemerisT {
+    T utcMinutes;  // Minutes past midnight GMT
+    double JDN;     // Julian Day Number
+    T JCN;     // Julian Century Number
+    T GMLS;    // Geometric Mean Longitude of Sun
+    T GMAS;    // Geometric Mean Anomaly of Sun
+    T EEO;     // Eccentricity of Earth Orbit (degrees)
+    T SEC;     // Sun Equation of Center 
+    T STL;     // Sun True Longitude (degrees)
+    T STA;     // Sun True Anomaly (degrees)
+    T SRV;     // Sun Radian Vector (degrees)
+    T SAL;     // Sun Apparent Longitude 
+    T MOE;     // Mean Oblique Ecliptic (degrees)
+    T OC;      // Oblique correction 
+    T SRA;     // Sun Right Ascension (degrees)
+    T SDec;    // Sun Declination (degrees)
+    T vy;		// var y
+    T EOT;     // Equation of Time (minutes)
+    int tier;  // SOLAR_TIER_ of the math this was worked out with
+};
+typedef SolarEphemerisT<double> SolarEphemeris;
+// Sun position at one site, calculated from a SolarEphemeris
+template <typename T>
+struct SolarPositionT {
+    T TST;     // True Solar Time (minutes)
+    T HA;      // Hour Angle (degrees)
+    T SZA;  // Solar Zenith Angle (degrees)
+    T SEA;     // Solar Elevation Angle (degrees)
+    T AAR;  // Approximate Atmospheric Refraction 
+    T SEC_Corr; // Solar Elevation, Corrected (degrees)
+    T SAA; // Solar Azimuth Angle (degrees)
+    int tier;  // SOLAR_TIER_ of the math this was worked out with
+};
+typedef SolarPositionT<double> SolarPosition;
+class SolarEphemerisFile;
+// A site prepared by initSolarSite(). The values that depend only on the site
+// are worked out once, so calculations for the site do not repeat the trig
+// of its latitude on every call.
+template <typename T>
+struct SolarSiteT {
+    int tz;         // Time zone Offset, zones west of GMT are negative
+    T latDeg;       // Latitude of site (degrees)
+    T lonDeg;       // Longitude of site (degrees)
+    T sinLatV;      // sin(lat)
+    T cosLatV;      // cos(lat)
+    T tanLatV;      // tan(lat)
+    T lonMin;       // 4 * lon, longitude as a time offset (minutes)
+    T tzDaysV;      // tzOffset / 24, time zone offset (days)
+    T cosHorizonV;  // cos(90.833 degrees), zenith angle at sunrise and sunset
+    int tier;       // SOLAR_TIER_ of the math used for the site
+    // Ephemeris file the per-day values for the site are taken from, or 0
+    // (see SolarEphemerisFile). initSolarSite() sets 0.
+    const SolarEphemerisFile *file;
+
+    int tzOffset() const { return tz; }
+    T lat() const { return latDeg; }
+    T lon() const { return lonDeg; }
+    T sinLat() const { return sinLatV; }
+    T cosLat() const { return cosLatV; }
+    T tanLat() const { return tanLatV; }
+    T lonMinutes() const { return lonMin; }
+    T tzDays() const { return tzDaysV; }
+    T cosHorizon() const { return cosHorizonV; }
+};
+typedef SolarSiteT<double> SolarSite;
+// Output arrays for calcSolarBatch(). Point each field you want at an array
+// with room for n values; fields left null are not calculated or written.
+struct SolarBatchOut {
+    double *SDec;           // Sun Declination (degrees)
+    double *EOT;            // Equation of Time (minutes)
+    double *HA;             // Hour Angle (degrees)
+    double *SZA;            // Solar Zenith Angle (degrees)
+    double *SEA;            // Solar Elevation Angle (degrees)
+    double *AAR;            // Approximate Atmospheric Refraction (degrees)
+    double *SEC_Corr;       // Solar Elevation, Corrected (degrees)
+    double *SAA;            // Solar Azimuth Angle (degrees)
+    time_t *SolarNoonTime;  // Solar Noon (Time object)
+    time_t *SunriseTime;    // Sunrise (Time object)
+    time_t *SunsetTime;     // Sunset (Time object)
+
+    SolarBatchOut() : SDec(0), EOT(0), HA(0), SZA(0), SEA(0), AAR(0),
+                      SEC_Corr(0), SAA(0), SolarNoonTime(0), SunriseTime(0),
+                      SunsetTime(0) {}
+};
+
+// A regular latitude/longitude grid for calcSolarRaster(). Row r is at
+// latitude lat0 + r * dLat and column c at longitude lon0 + c * dLon, in
+// degrees; dLat is usually negative so that row 0 is the northern edge.
+// Point (r, c) is element r * cols + c of each output array.
+struct SolarGrid {
+    double lat0;    // Latitude of row 0 (degrees)
+    double lon0;    // Longitude of column 0 (degrees)
+    double dLat;    // Latitude step from one row to the next (degrees)
+    double dLon;    // Longitude step from one column to the next (degrees)
+    size_t rows;    // Number of rows
+    size_t cols;    // Number of columns
+};
+
+// Elevation of the sun's centre at sunrise and sunset (degrees), allowing
+// for refraction and the sun's radius. calcSolarDay() uses the same value,
+// as a zenith angle of 90.833 degrees.
+#define SOLAR_HORIZON			-0.833
+
+// Column flags for SolarColumns, one per SolarBatchOut field
+#define SOLAR_COL_SDEC			0x0001
+#define SOLAR_COL_EOT			0x0002
+#define SOLAR_COL_HA			0x0004
+#define SOLAR_COL_SZA			0x0008
+#define SOLAR_COL_SEA			0x0010
+#define SOLAR_COL_AAR			0x0020
+#define SOLAR_COL_SEC_CORR		0x0040
+#define SOLAR_COL_SAA			0x0080
+#define SOLAR_COL_NOON			0x0100
+#define SOLAR_COL_SUNRISE		0x0200
+#define SOLAR_COL_SUNSET		0x0400
+#define SOLAR_COL_ALL			0x07FF
+
+// Batch results stored as one array per field (structure of arrays). Only
+// the columns named in the mask given to allocate() are allocated, in a
+// single block; the pointers for the others stay null, so calcSolarBatch()
+// never calculates or writes them. Keeping just elevation and azimuth costs
+// 16 bytes per row:
+//
+// 		SolarColumns cols(n, SOLAR_COL_SEC_CORR | SOLAR_COL_SAA);
+// 		calcSolarBatch(times, n, cols);
+// 		double e = cols.out().SEC_Corr[i];
+class SolarColumns {
+  public:
+	SolarColumns();
+	SolarColumns(size_t n, unsigned int columns);
+	~SolarColumns();
+	// Allocate room for n rows of the columns in mask (an OR of SOLAR_COL_
+	// flags), releasing any previous columns. Returns false if the memory
+	// could not be allocated, or its size does not fit in a size_t, leaving
+	// no rows and no columns. With n of 0 the columns are set but their
+	// pointers stay null.
+	bool allocate(size_t n, unsigned int columns);
+	// Free the columns
+	void release();
+	// Number of rows allocated
+	size_t size() const { return rows; }
+	// Columns allocated (SOLAR_COL_ flags)
+	unsigned int columns() const { return mask; }
+	// Pointers to the allocated columns, null for the rest
+	const SolarBatchOut &out() const { return cols; }
+  private:
+	// Columns own their memory, so they cannot be copied
+	SolarColumns(const SolarColumns &);
+	SolarColumns &operator=(const SolarColumns &);
+	SolarBatchOut cols;
+	void *block;
+	size_t rows;
+	unsigned int mask;
+};
+
+// Handle for a site in a SolarSiteRegistry. It stays valid, and keeps
+// naming the same site, until that site is removed, however many other sites
+// are added or removed in between.
+typedef uint32_t SolarSiteHandle;
+#define SOLAR_NO_SITE			0xFFFFFFFFUL
+
+// A set of sites stored as one array per value (latitude sine and cosine,
+// longitude offset, time zone offset), so calcSolarFleet() can work through
+// all of them in one vectorized pass. The arrays are packed: removing a site
+// moves the last one into its place. Use handles to keep track of a site,
+// and indexOf() to find its row in the arrays and in calcSolarFleet()'s
+// output:
+//
+// 		SolarSiteRegistry fleet;
+// 		SolarSiteHandle h = fleet.add(-8, 36.62, -121.904);
+// 		SolarColumns cols(fleet.size(), SOLAR_COL_SEC_CORR | SOLAR_COL_SAA);
+// 		calcSolarFleet(utcMillis, fleet, cols);
+// 		double e = cols.out().SEC_Corr[fleet.indexOf(h)];
+class SolarSiteRegistry {
+  public:
+	SolarSiteRegistry();
+	~SolarSiteRegistry();
+	// Add a site. Returns its handle, or SOLAR_NO_SITE if memory ran out.
+	SolarSiteHandle add(int tzOffset, double lat, double lon);
+	// Remove a site. Returns false if h does not name a site in the registry.
+	bool remove(SolarSiteHandle h);
+	// Whether h names a site in the registry
+	bool contains(SolarSiteHandle h) const;
+	// Row of the site in the arrays below, or -1 if h names no site
+	long indexOf(SolarSiteHandle h) const;
+	// Handle of the site in row i
+	SolarSiteHandle handleAt(size_t i) const { return handles[i]; }
+	// Number of sites
+	size_t size() const { return count; }
+	// Make room for n sites without further allocation. Returns false if
+	// the memory could not be allocated.
+	bool reserve(size_t n);
+	// Remove every site. Handles given out before are no longer valid.
+	void clear();
+	// The sites, one row each
+	const int *tzOffset() const { return tz; }
+	const double *lat() const { return latDeg; }
+	const double *lon() const { return lonDeg; }
+	const double *sinLat() const { return sinLatV; }
+	const double *cosLat() const { return cosLatV; }
+	const double *lonMinutes() const { return lonMin; }	// 4 * lon
+  private:
+	// Sites own their memory, so they cannot be copied
+	SolarSiteRegistry(const SolarSiteRegistry &);
+	SolarSiteRegistry &operator=(const SolarSiteRegistry &);
+	void *block;		// every array below, in one allocation
+	size_t count;		// sites in use
+	size_t capacity;	// sites there is room for
+	double *latDeg;
+	double *lonDeg;
+	double *sinLatV;
+	double *cosLatV;
+	double *lonMin;
+	int *tz;
+	SolarSiteHandle *handles;	// handle of each row
+	// Per handle slot: its row while in use, else the next free slot
+	uint32_t *slotRow;
+	uint8_t *slotGen;	// bumped on removal so old handles stop matching
+	size_t slots;		// slots handed out so far
+	uint32_t freeSlot;	// first free slot, or SOLAR_NO_SITE
+};
+
+// A queue of batch, fleet and raster jobs of any size, run together so that
+// every core stays busy. run() cuts each job into chunks of about equal
+// estimated cost, at the same block and tile boundaries as the functions
+// above, so results are the same bit for bit as calling them one by one.
+// With SOLARLIB_THREADS each of getSolarThreads() workers starts with an
+// even share of the chunks, takes its own newest chunk first, and when it
+// runs out steals the oldest chunk of another worker. Each chunk is worked
+// out with its own per-day values and scratch space; the workers share
+// nothing but the job list and write to separate parts of the outputs.
+// Without SOLARLIB_THREADS, run() does the jobs in turn on the calling
+// thread.
+//
+// 		SolarScheduler jobs;
+// 		jobs.addBatch(site, times, n, out);			// one site for one year
+// 		jobs.addRaster(utcMillis, grid, map);		// one world map
+// 		jobs.run();
+//
+// The time arrays, registries and outputs given to the add functions must
+// stay as they are until run() returns. A job with nothing to work out (no
+// times, no sites, or a grid with no rows or no columns) is not queued.
+struct SolarSchedJob;
+class SolarChebyshev;
+class SolarScheduler {
+  public:
+	SolarScheduler();
+	~SolarScheduler();
+	// Queue the same work as calcSolarBatch(), for the given site. Returns
+	// false if memory ran out.
+	bool addBatch(const SolarSite &site, const int64_t *t, size_t n,
+				  const SolarBatchOut &out, const SolarChebyshev *fit = 0);
+	// Queue the same work as calcSolarFleet()
+	bool addFleet(int64_t utcMillis, const SolarSiteRegistry &sites,
+				  const SolarBatchOut &out);
+	// Queue the same work as calcSolarRaster()
+	bool addRaster(int64_t utcMillis, const SolarGrid &grid,
+				   const SolarBatchOut &out, uint8_t *daylight = 0);
+	// Run every queued job, returning when all are done, and empty the queue
+	void run();
+	// Number of jobs queued
+	size_t pending() const { return count; }
+	// Empty the queue without running the jobs
+	void clear() { count = 0; }
+  private:
+	// Jobs own their memory, so they cannot be copied
+	SolarScheduler(const SolarScheduler &);
+	SolarScheduler &operator=(const SolarScheduler &);
+	bool push(const SolarSchedJob &job);
+	SolarSchedJob *jobs;
+	size_t count;		// jobs queued
+	size_t capacity;	// jobs there is room for
+};
+
+// Steps between full ephemeris calculations in a SolarSweep, and the most
+// time (milliseconds) those steps may cover
+#define SOLAR_SWEEP_REFRESH		60
+#define SOLAR_SWEEP_SPAN		3600000
+
+// Sun positions for one site at evenly spaced times, such as every minute
+// of a year. calcSolar() works out each time from scratch; a sweep instead
+// calculates the ephemeris only every `refresh` steps, and in between moves
+// the declination and equation of time along a straight line to the next
+// one. The hour angle then grows by the same amount every step, so its sine
+// and cosine are carried forward by the angle-addition formulas, and are
+// worked out afresh with sin() and cos() at each refresh so rounding cannot
+// build up. What is left per step is a handful of multiply-adds, two acos()
+// and a sqrt(). With a SolarChebyshev fit, the ephemeris at each refresh is
+// taken from it for the times it covers. See extras/sweep/README.md for how
+// closely it follows calcSolarMillis().
+//
+// 		SolarSweep sweep(site, start, end, 60000);	// every minute
+// 		SolarPosition P;
+// 		while (sweep.next(P)) {
+// 			// P holds the position at sweep.time()
+// 		}
+class SolarSweep {
+  public:
+	// Times start, start + step, ... up to and including end, in
+	// milliseconds since 1970-1-1 (local time zone, as calcSolarMillis()).
+	// step must be positive. refresh is lowered as needed so the steps
+	// between two ephemeris calculations cover at most SOLAR_SWEEP_SPAN;
+	// with steps of an hour or more, every step gets a full ephemeris.
+	// fit, if given, must stay fitted for the life of the sweep.
+	SolarSweep(const SolarSite &site, int64_t start, int64_t end,
+			   int64_t step, unsigned int refresh = SOLAR_SWEEP_REFRESH,
+			   const SolarChebyshev *fit = 0);
+	// Fill P with the position at the next time. Returns false, leaving P
+	// alone, once past end.
+	bool next(SolarPosition &P);
+	// Time of the position last given by next()
+	int64_t time() const { return t - step; }
+	// Declination (degrees) and equation of time (minutes) at that time
+	double getSDec() const { return decV - dDec; }
+	double getEOT() const { return eotV - dEot; }
+  private:
+	// Work out the ephemeris at the current time and refresh - 1 steps
+	// ahead, and restart the hour angle and declination from them
+	void anchor();
+	// Ephemeris at time ms (local time zone)
+	void ephemerisAt(int64_t ms, SolarEphemeris &E) const;
+	SolarSite site;
+	const SolarChebyshev *fit;	// ephemeris fit, or 0
+	int64_t t;				// time of the next step
+	int64_t end;
+	int64_t step;
+	unsigned int refresh;	// steps between full ephemeris calculations
+	unsigned int left;		// steps left before the next one
+	SolarEphemeris ahead;	// ephemeris at the next anchor
+	bool aheadValid;
+	double stepMinutes;		// step (minutes)
+	double haV, dHa;		// hour angle (degrees) and its step
+	double sinHa, cosHa;	// sine and cosine of the hour angle
+	double sinDHa, cosDHa;	// of the hour angle step
+	double decV, dDec;		// declination (degrees) and its step
+	double sinDec, cosDec;	// sine and cosine of the declination
+	double sinDDec, cosDDec;	// of the declination step
+	double eotV, dEot;		// equation of time (minutes) and its step
+};
+
+// Days covered by one segment of a SolarChebyshev fit, and Chebyshev terms
+// per value per segment. Single precision (double on AVR) needs fewer. Each
+// term left out costs about two digits.
+#define SOLAR_CHEB_DAYS			16
+#if !defined(SOLAR_CHEB_TERMS)
+#if defined(__AVR__)
+#define SOLAR_CHEB_TERMS		6
+#else
+#define SOLAR_CHEB_TERMS		8
+#endif
+#endif
+// The library's range of days since 1970-1-1: 1901-1-1 to 2099-12-31
+#define SOLAR_FIRST_DAY			-25202L
+#define SOLAR_LAST_DAY			47481L
+
+// Declination, equation of time and Sun Radius Vector fitted with Chebyshev
+// polynomials, one set per SOLAR_CHEB_DAYS days. All three change slowly and
+// smoothly, so a short series stands in for the chain of sin(), atan2(),
+// asin() and tan() calls behind them: eval() is a few dozen multiply-adds.
+// fit() works the series out from the full calculation at the Chebyshev
+// nodes of each segment, so nothing needs to be shipped with the library;
+// the whole 1901 to 2099 range takes 870 kB and about 10 ms. The fitted
+// values stay within 1e-9 degree and 1e-9 minute of the NOAA equations;
+// see extras/chebyshev/README.md.
+//
+// 		SolarChebyshev fit;
+// 		fit.fit(19723, 20088);		// 2024 only
+// 		SolarEphemeris E;
+// 		fit.eval(utcMillis, E);
+// 		calcSolarPosition(E, site, P);
+//
+// Hand one to calcSolarBatch() or SolarSweep to have them use it in place of
+// the full ephemeris.
+class SolarChebyshev {
+  public:
+	SolarChebyshev();
+	~SolarChebyshev();
+	// Fit the days firstDay to lastDay (days since 1970-1-1, GMT), dropping
+	// any earlier fit. Returns false if lastDay is before firstDay or the
+	// memory cannot be had, leaving nothing fitted.
+	bool fit(long firstDay = SOLAR_FIRST_DAY, long lastDay = SOLAR_LAST_DAY);
+	// Free the coefficients
+	void release();
+	// True if time utcMillis (milliseconds since 1970-1-1, GMT) is in the
+	// fitted days
+	bool covers(int64_t utcMillis) const;
+	// Fill the utcMinutes, JDN, JCN, SRV, SDec and EOT fields of E for time
+	// utcMillis, as calcSolarEphemerisMillis() would; the other fields are
+	// left alone, and calcSolarPosition() does not need them. Returns false,
+	// leaving E alone, if the time is not covered.
+	bool eval(int64_t utcMillis, SolarEphemeris &E) const;
+	long firstDay() const { return first; }
+	long lastDay() const { return last; }
+  private:
+	// The coefficients are one block, so the fit cannot be copied
+	SolarChebyshev(const SolarChebyshev &);
+	SolarChebyshev &operator=(const SolarChebyshev &);
+	double *coef;		// per segment: SDec, EOT, SRV terms
+	long first;			// first day fitted
+	long last;			// last day fitted
+};
+
+// Ephemeris file layout. The file is a SolarTableHeader followed by one
+// SolarTableRecord per day, each the ephemeris at 12:00 GMT, written in the
+// byte order of the machine that made it. A reader checks the magic, the
+// version and the endian tag, and takes the records as they are, so a file
+// is only usable on machines of the same byte order and double format.
+#define SOLAR_TABLE_MAGIC		"SOLAREPH"
+#define SOLAR_TABLE_VERSION		1
+#define SOLAR_TABLE_ENDIAN		0x01020304UL
+struct SolarTableHeader {
+	char magic[8];			// SOLAR_TABLE_MAGIC, without the ending 0
+	uint32_t endian;		// SOLAR_TABLE_ENDIAN, in the writer's byte order
+	uint16_t version;		// SOLAR_TABLE_VERSION
+	uint16_t headerSize;	// sizeof(SolarTableHeader), 32
+	uint16_t recordSize;	// sizeof(SolarTableRecord), 24
+	uint16_t reserved;		// 0
+	int32_t firstDay;		// day of the first record (days since 1970-1-1)
+	uint32_t days;			// number of records
+	uint32_t spare;			// 0
+};
+struct SolarTableRecord {
+	double SDec;	// Sun Declination (degrees)
+	double EOT;		// Equation of Time (minutes)
+	double SRV;		// Sun Radius Vector (Astronomical Units)
+};
+
+// A per-day ephemeris table, read in place from an ephemeris file (see
+// extras/ephemeris/ for the tool that writes one for 1901 to 2099, 1.7 MB).
+// open() maps the file read-only with mmap(), so any number of processes
+// on one machine share a single copy in the page cache, and nothing is
+// worked out at startup. attach() takes a table already in memory, such as
+// one stored in flash. Point a site's file at it, or hand it to
+// SolarContext::setEphemerisFile(), to have the per-day values (solar noon,
+// sunrise, sunset) use it:
+//
+// 		SolarEphemerisFile table;
+// 		if (table.open("/var/lib/solar/ephemeris.bin")) {
+// 			context.setEphemerisFile(&table);
+// 		}
+class SolarEphemerisFile {
+  public:
+	SolarEphemerisFile();
+	~SolarEphemerisFile();
+	// Use the table of bytes bytes at data, which must stay in place until
+	// close(). Returns false, leaving nothing attached, if the header does
+	// not match this library and machine or the records run past the end.
+	bool attach(const void *data, size_t bytes);
+	// Map the file at path and attach it. Returns false if it cannot be
+	// opened or mapped, or attach() fails. Only where mmap() is available;
+	// elsewhere it always returns false.
+	bool open(const char *path);
+	// Unmap or let go of the table
+	void close();
+	// The declination (degrees), equation of time (minutes) and Sun Radius
+	// Vector (AU) at local noon on day unixDays (days since 1970-1-1) in
+	// time zone tzOffset, interpolated between the records either side.
+	// Returns false, leaving them alone, if the day is not covered.
+	bool noon(long unixDays, int tzOffset, double &SDec, double &EOT,
+			  double &SRV) const;
+	long firstDay() const { return first; }
+	long size() const { return count; }
+	// Goes up each time the table is attached or let go of, so a cache of
+	// values taken from it can tell they are stale
+	unsigned long generation() const { return gen; }
+  private:
+	SolarEphemerisFile(const SolarEphemerisFile &);
+	SolarEphemerisFile &operator=(const SolarEphemerisFile &);
+	const SolarTableRecord *records;
+	long first;			// day of records[0]
+	long count;			// number of records
+	void *map;			// mapping made by open(), or 0
+	size_t mapBytes;
+	unsigned long gen;	// see generation()
+};
+
+//----------------------------------------------------------------------------
+// Calculation stages
+// calcSolar() works through the stages below in order. Each flag lists the
+// SolarElements fields that stage fills in. Pass an OR of flags to the
+// calcSolar(t, SE, mask) overload to have it run only the stages those
+// fields require; any stage a requested stage depends on is added for you.
+#define SOLAR_TIME			0x0001	// timeFracDay, unixDays, JDN, JCN
+#define SOLAR_MEAN			0x0002	// GMLS, GMAS, EEO
+#define SOLAR_CENTER		0x0004	// SEC, STL, STA, SRV
+#define SOLAR_OBLIQUITY		0x0008	// SAL, MOE, OC
+#define SOLAR_DECLINATION	0x0010	// SRA, SDec
+#define SOLAR_EOT			0x0020	// vy, EOT
+#define SOLAR_NOON			0x0040	// SolarNoonfrac, SolarNoonDays, SolarNoonTime
+#define SOLAR_RISESET		0x0080	// HAS, Sunrise(Time), Sunset(Time), SunDuration
+#define SOLAR_HOURANGLE		0x0100	// TST, HA
+#define SOLAR_ZENITH		0x0200	// SZA, SEA
+#define SOLAR_REFRACTION	0x0400	// AAR, SEC_Corr
+#define SOLAR_AZIMUTH		0x0800	// SAA
+#define SOLAR_ALL			0x0FFF	// every field
+
 //----------------------------------------------------------------------------
 // Functions
 // Initialization function to put time zone offset, latitude, and longitude in
-// the SolarElements structure
+// the SolarElements structure of the default SolarContext
 void initSolarCalc(int tzOffset, double lat, double lon);
 // Return latitude used in solar calculations
 double getlat(); 
@@ -174,10 +724,263 @@ double getSEC_Corr(time_t t);
 // Extract Solar Azimuth Angle (degrees clockwise from North)
 double getSAA(time_t t);
 
+// Cache counters for the default context. Consecutive extractor calls with the
+// same time value reuse the stored results instead of running calcSolar()
+// again; these report how often that happened.
+unsigned long getSolarCacheHits();
+unsigned long getSolarCacheMisses();
+void resetSolarCacheStats();
+// Calculate n time values (milliseconds since 1970-1-1, local time zone) for
+// the default site in one call, writing the fields that have arrays in out.
+// Only the stages those fields need are run, and sunrise, noon and sunset are
+// worked out once per day rather than once per time value. With a fit, the
+// declination and equation of time are taken from it, for the times it
+// covers, instead of working out the full ephemeris, so the results are the
+// same with or without a vectorized kernel (see getSolarKernel()). The fit
+// saves time only where there is none, such as on ARM and AVR boards; the
+// kernel works out the ephemeris faster than it can evaluate the fit. fit
+// must stay fitted until the call returns.
+void calcSolarBatch(const int64_t *t, size_t n, const SolarBatchOut &out,
+                    const SolarChebyshev *fit = 0);
+// Same as above, writing to the columns allocated in cols. n must not be
+// larger than cols.size().
+void calcSolarBatch(const int64_t *t, size_t n, SolarColumns &cols,
+                    const SolarChebyshev *fit = 0);
+// Calculate the sun position at one instant (milliseconds since 1970-1-1,
+// GMT) for every site in sites, writing row i of each column in out for the
+// site in row i of the registry. HA, SZA, SEA, AAR, SEC_Corr and SAA are
+// per site; SDec and EOT, if asked for, are the same for every row. The
+// per-day columns are not written. The ephemeris is worked out once and the
+// sites are handled by the same vectorized kernel as calcSolarBatch().
+void calcSolarFleet(int64_t utcMillis, const SolarSiteRegistry &sites,
+                    const SolarBatchOut &out);
+// Same as above, writing to the columns allocated in cols. If cols has
+// fewer rows than there are sites, only that many sites are calculated.
+void calcSolarFleet(int64_t utcMillis, const SolarSiteRegistry &sites,
+                    SolarColumns &cols);
+// Calculate the sun position at one instant (milliseconds since 1970-1-1,
+// GMT) at every point of grid, writing a dense row-major raster to the
+// columns of out that are not null. daylight, if not null, gets 1 where the
+// sun is above the horizon (elevation above SOLAR_HORIZON) and 0 where it
+// is not. The ephemeris is worked out once for the whole grid, the
+// latitude trig once per row and the hour angle once per column, and the
+// grid is calculated in cache-sized tiles by the same vectorized kernel as
+// calcSolarBatch(). A 0.05 degree world map is 7200 by 3600:
+//
+// 		SolarGrid grid = { 89.975, -179.975, -0.05, 0.05, 3600, 7200 };
+// 		calcSolarRaster(utcMillis, grid, out, daylight);
+//
+// Azimuth is undefined at the poles themselves.
+void calcSolarRaster(int64_t utcMillis, const SolarGrid &grid,
+                     const SolarBatchOut &out, uint8_t *daylight = 0);
+// Same as above, writing to the columns allocated in cols. Only as many
+// whole rows as fit in cols are calculated.
+void calcSolarRaster(int64_t utcMillis, const SolarGrid &grid,
+                     SolarColumns &cols, uint8_t *daylight = 0);
+// Number of threads calcSolarBatch(), calcSolarFleet() and calcSolarRaster()
+// split their work over. This is 1 unless the library is built with
+// SOLARLIB_THREADS defined (and linked with -pthread), in which case it is
+// one per core unless set otherwise. The work is cut at the same block and
+// tile boundaries as the single-threaded path, so results are the same bit
+// for bit whatever the number of threads. Calls too small to be worth it use
+// fewer threads, down to the calling thread alone. The three functions only
+// read the default site, so they may also be called from several threads at
+// once, as long as initSolarCalc() is not called at the same time.
+unsigned int getSolarThreads();
+// Use n threads for the functions above; 0 goes back to one per core. Has
+// no effect without SOLARLIB_THREADS. May be called while other threads run
+// them; each call uses the number set when it started.
+void setSolarThreads(unsigned int n);
+// Name of the batch kernel calcSolarBatch() uses on this machine: "avx512",
+// "avx2", "sse4.2", "native" (built for the compiler's target), or "scalar"
+// when it runs calcSolar()'s engine row by row. Handy for logging.
+const char *getSolarKernel();
+// Use the named kernel instead of the best one, e.g. to compare results.
+// Returns false, leaving the choice alone, if this machine cannot run it.
+// Passing 0 goes back to the best one. Not safe to call while another
+// thread is inside calcSolarBatch().
+bool setSolarKernel(const char *name);
+// Fill in the header of an ephemeris file of days records from firstDay
+void initSolarTableHeader(SolarTableHeader &h, long firstDay,
+                          unsigned long days);
+// Work out the record for day unixDays (days since 1970-1-1)
+void calcSolarTableRecord(long unixDays, SolarTableRecord &r);
+
 // Main function to update the contents of the Solar Elements structure SE with
 // new solar calculations, using the given Time t input. The initSolarCalc()
 // function must previously have been run once so that the appropriate time zone
 // offset, latitude, and longitude are set. 
-void calcSolar(time_t t, SolarElements &SE);
+// The functions below are templates on the scalar type T, instantiated for
+// float, double and long double. Passing a SolarElements picks double.
+template <typename T>
+void calcSolar(time_t t, SolarElementsT<T> &SE);
+// Same as above, but only calculate the stages needed for the fields named in
+// mask (an OR of the SOLAR_ stage flags). Fields outside those stages are left
+// unchanged.
+template <typename T>
+void calcSolar(time_t t, SolarElementsT<T> &SE, unsigned int mask);
+// The same calculation for times given with more than whole-second
+// resolution, or beyond the range of a 32-bit time_t (2038). All are in the
+// local time zone, like t above:
+// 		calcSolarMillis()	- milliseconds since 1970-1-1
+// 		calcSolarUnix()		- seconds since 1970-1-1, with a fractional part
+// 		calcSolarJ2000()	- seconds since 2000-1-1 12:00 (J2000.0)
+// The fraction of a second is carried through timeFracDay, JDN and JCN.
+template <typename T>
+void calcSolarMillis(int64_t ms, SolarElementsT<T> &SE,
+                     unsigned int mask = SOLAR_ALL);
+template <typename T>
+void calcSolarUnix(double seconds, SolarElementsT<T> &SE,
+                   unsigned int mask = SOLAR_ALL);
+template <typename T>
+void calcSolarJ2000(double seconds, SolarElementsT<T> &SE,
+                    unsigned int mask = SOLAR_ALL);
+// Return mask with every stage it depends on added
+unsigned int solarResolveMask(unsigned int mask);
+// Fill in a SolarSite for the given time zone offset, latitude and longitude.
+// tier is the accuracy tier of the math functions the calculations for the
+// site use: SOLAR_TIER_FULL (the default), SOLAR_TIER_FINE or
+// SOLAR_TIER_COARSE; a value that is not a tier is taken as
+// SOLAR_TIER_FULL. The tier each result was worked out with is in its tier
+// field. The vectorized kernels behind calcSolarBatch(), calcSolarFleet()
+// and calcSolarRaster() are not affected; they run at full precision in a
+// fraction of the time of any tier. Functions that take the site from a
+// SolarElements rather than a SolarSite always use the full tier.
+template <typename T>
+void initSolarSite(SolarSiteT<T> &site, int tzOffset, double lat, double lon,
+                   int tier = SOLAR_TIER_FULL);
+// calcSolarMillis() for a site prepared with initSolarSite(), at the site's
+// tier. The site is copied into SE's tzOffset, lat and lon.
+template <typename T>
+void calcSolarMillis(int64_t ms, const SolarSiteT<T> &site,
+                     SolarElementsT<T> &SE, unsigned int mask = SOLAR_ALL);
+// Calculate the site-independent ephemeris (declination, equation of time and
+// the values leading up to them) for time t, given in GMT rather than local
+// time, at accuracy tier tier. Do this once per time value, then call
+// calcSolarPosition() for each site.
+template <typename T>
+void calcSolarEphemeris(time_t t, SolarEphemerisT<T> &E,
+                        int tier = SOLAR_TIER_FULL);
+// Same as above, for a time in milliseconds since 1970-1-1 GMT
+template <typename T>
+void calcSolarEphemerisMillis(int64_t ms, SolarEphemerisT<T> &E,
+                              int tier = SOLAR_TIER_FULL);
+// Calculate hour angle, zenith, elevation, refraction and azimuth for a site
+// at latitude lat and longitude lon, using an ephemeris from
+// calcSolarEphemeris(). Time zone offset is not needed since the ephemeris
+// time is in GMT.
+template <typename T>
+void calcSolarPosition(const SolarEphemerisT<T> &E, double lat, double lon,
+                       SolarPositionT<T> &P);
+// Same as above for a site prepared with initSolarSite(), at the site's
+// tier. Use this when calculating the same sites over and over.
+template <typename T>
+void calcSolarPosition(const SolarEphemerisT<T> &E, const SolarSiteT<T> &site,
+                       SolarPositionT<T> &P);
+// Calculate the per-day values (HAS, solar noon, sunrise, sunset, day length)
+// for the given day (days since 1970-1-1, local time zone) and site. This is
+// what calcSolar() uses for the SOLAR_NOON and SOLAR_RISESET stages. With a
+// SolarSite, at the site's tier, and with the declination and equation of
+// time at local noon taken from the site's ephemeris file for the days it
+// covers. Sunrise and sunset then agree with the full calculation to within
+// a millisecond.
+template <typename T>
+void calcSolarDay(long unixDays, int tzOffset, double lat, double lon,
+                  SolarDayT<T> &SD);
+template <typename T>
+void calcSolarDay(long unixDays, const SolarSiteT<T> &site, SolarDayT<T> &SD);
+
+//----------------------------------------------------------------------------
+// SolarContext
+// Holds one site (time zone offset, latitude, longitude) together with its own
+// SolarElements result cache. Each SolarContext is independent of every other,
+// so several sites can be calculated side by side, or one context can be
+// given to each thread, without results overwriting each other. The free
+// functions above all operate on a single default SolarContext.
+class SolarContext {
+  public:
+	SolarContext();
+	SolarContext(int tzOffset, double lat, double lon);
+	// Set time zone offset, latitude, and longitude for this context. The
+	// tier is kept.
+	void init(int tzOffset, double lat, double lon);
+	// Accuracy tier of the math functions used for this context's results
+	// (see initSolarSite()), SOLAR_TIER_FULL unless set. Changing it drops
+	// the cached results. Returns false, leaving the tier alone, for a value
+	// that is not a tier.
+	bool setTier(int tier);
+	int getTier();
+	// Take the per-day values from file (see calcSolarDay()); 0 goes back to
+	// working them out. Kept by init(). The cached results are dropped, and
+	// dropped again whenever the file is attached or closed.
+	void setEphemerisFile(const SolarEphemerisFile *file);
+	const SolarEphemerisFile *getEphemerisFile();
+	int gettzOffset();
+	double getlat();
+	double getlon();
+	double gettimeFracDay(time_t t);
+	long getunixDays(time_t t);
+	double getJDN(time_t t);
+	double getJCN(time_t t);
+	double getGMLS(time_t t);
+	double getGMAS(time_t t);
+	double getEEO(time_t t);
+	double getSEC(time_t t);
+	double getSTL(time_t t);
+	double getSTA(time_t t);
+	double getSRV(time_t t);
+	double getSAL(time_t t);
+	double getMOE(time_t t);
+	double getOC(time_t t);
+	double getSRA(time_t t);
+	double getSDec(time_t t);
+	double getvy(time_t t);
+	double getEOT(time_t t);
+	double getHAS(time_t t);
+	double getSolarNoonfrac(time_t t);
+	double getSolarNoonDays(time_t t);
+	time_t getSolarNoonTime(time_t t);
+	double getSunrise(time_t t);
+	time_t getSunriseTime(time_t t);
+	double getSunset(time_t t);
+	time_t getSunsetTime(time_t t);
+	double getSunDuration(time_t t);
+	double getTST(time_t t);
+	double getHA(time_t t);
+	double getSZA(time_t t);
+	double getSEA(time_t t);
+	double getAAR(time_t t);
+	double getSEC_Corr(time_t t);
+	double getSAA(time_t t);
+	// Run calcSolar() for time t and return the whole SolarElements structure
+	const SolarElements &getElements(time_t t);
+	// calcSolarBatch() for this context's site. Leaves the context's cache
+	// alone, so it may be called from several threads at once.
+	void calcBatch(const int64_t *t, size_t n, const SolarBatchOut &out,
+				   const SolarChebyshev *fit = 0);
+	// Number of extractor calls answered from the cache without recalculating
+	unsigned long getCacheHits();
+	// Number of extractor calls that had to run calcSolar()
+	unsigned long getCacheMisses();
+	// Set the hit and miss counters back to zero
+	void resetCacheStats();
+  private:
+	// Calculate the stages in mask unless SE already holds them for this t
+	// and site
+	void update(time_t t, unsigned int mask);
+	SolarElements SE; // site parameters and cache of calculated values
+	SolarSite site;		// the same site, prepared by initSolarSite()
+	unsigned int cachedStages;	// stages in SE that are valid for the key below
+	time_t keyT;		// time value the cached results were calculated for
+	int keyTzOffset;	// site the cached results were calculated for
+	double keyLat;
+	double keyLon;
+	unsigned long keyFileGen;	// generation() of the file, if any
+	unsigned long cacheHits;
+	unsigned long cacheMisses;
+	SolarDay day;		// per-day values, reused for every time in that day
+	bool dayValid;		// true once day holds values for the current site
+	unsigned long dayFileGen;	// generation() of the file day came from
+};
 
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+/* accuracy.cpp
+ * Compare the float and double versions of calcSolar() against the long
+ * double version over the 1901 to 2099 range the library is documented for.
+ * Runs on a desktop machine, not on an Arduino. Build from this directory:
+ * 
+ * 		g++ -O2 -I../.. accuracy.cpp ../../Solarlib.cpp ../../SolarKernel.cpp \
+ * 			-o accuracy
+ * 		./accuracy
+ * 
+ * The output is the table found in README.md.
+ */
+#include <stdio.h>
+#include "Solarlib.h"
+#include "../common/sites.h"
+
+struct MaxErr {
+	double elev;	// degrees
+	double azim;	// degrees
+	double rise;	// seconds
+};
+
+// Largest differences between the T version and the long double version
+template <typename T>
+static void compare(time_t t, const SolarElementsT<long double> &ref,
+					SolarElementsT<T> &SE, MaxErr &err){
+	SE.tzOffset = ref.tzOffset;
+	SE.lat = (T)ref.lat;
+	SE.lon = (T)ref.lon;
+	calcSolar(t, SE);
+	double e = absd((double)SE.SEC_Corr - (double)ref.SEC_Corr);
+	if (e > err.elev) err.elev = e;
+	// Azimuth is only meaningful while the sun is up, and is poorly defined
+	// right at the zenith
+	if (ref.SEA > 0 && ref.SEA < 89) {
+		double a = absd((double)SE.SAA - (double)ref.SAA);
+		if (a > 180) a = 360 - a;
+		if (a > err.azim) err.azim = a;
+	}
+	// Polar day and night give no sunrise
+	if (ref.HAS == ref.HAS && SE.HAS == SE.HAS) {
+		double r = absd(SE.Sunrise - ref.Sunrise);
+		if (r > err.rise) err.rise = r;
+	}
+}
+
+int main(){
+	// 1901-01-01 to 2099-12-31, stepping by an odd interval so the samples
+	// drift through every time of day
+	const time_t start = -2177452800LL;
+	const time_t end = 4102358400LL;
+	const time_t step = 7 * 3600 + 13 * 60;
+	MaxErr fErr = { 0, 0, 0 };
+	MaxErr dErr = { 0, 0, 0 };
+	long samples = 0;
+	for (unsigned int s = 0; s < NSITES; s++) {
+		SolarElementsT<long double> ref;
+		SolarElementsT<float> f;
+		SolarElementsT<double> d;
+		ref.tzOffset = (int)sites[s][0];
+		ref.lat = sites[s][1];
+		ref.lon = sites[s][2];
+		for (time_t t = start; t < end; t += step) {
+			calcSolar(t, ref);
+			compare(t, ref, f, fErr);
+			compare(t, ref, d, dErr);
+			samples++;
+		}
+	}
+	printf("%ld samples, errors relative to long double\n\n", samples);
+	printf("| Scalar type | Elevation (deg) | Azimuth (deg) | Sunrise (s) |\n");
+	printf("|-------------|-----------------|---------------|-------------|\n");
+	printf("| float       | %.2e        | %.2e      | %.2e    |\n",
+		   fErr.elev, fErr.azim, fErr.rise);
+	printf("| double      | %.2e        | %.2e      | %.2e    |\n",
+		   dErr.elev, dErr.azim, dErr.rise);
+	return 0;
+}
@@ -0,0 +1,99 @@
+/* cache.cpp
+ * Check that a SolarContext answers consecutive extractor calls for the
+ * same time from its cache, and recalculates when the time, the site or the
+ * tier changes. Each case counts the hits and misses with getCacheHits()
+ * and getCacheMisses(), and compares what the extractors return with a
+ * fresh context. Runs on a desktop machine, not on an Arduino. Build from
+ * this directory:
+ *
+ * 		g++ -O2 -I../.. cache.cpp ../../Solarlib.cpp ../../SolarKernel.cpp \
+ * 			-o cache
+ * 		./cache
+ *
+ * The output is the table found in README.md. Exits with 1 if any case
+ * differs from what is expected.
+ */
+#include <stdio.h>
+#include "Solarlib.h"
+#include "../common/sites.h"
+
+static int failures = 0;
+
+// Whether ctx gives the same position and sunrise at t as a fresh context
+// for the same site and tier
+static bool sameAsFresh(SolarContext &ctx, time_t t){
+	SolarContext fresh(ctx.gettzOffset(), ctx.getlat(), ctx.getlon());
+	fresh.setTier(ctx.getTier());
+	return ctx.getSEC_Corr(t) == fresh.getSEC_Corr(t) &&
+		   ctx.getSAA(t) == fresh.getSAA(t) &&
+		   ctx.getSunriseTime(t) == fresh.getSunriseTime(t);
+}
+
+// Print a table row for one case, and count it as a failure if the hits and
+// misses are not those expected or the values at t differ from a fresh
+// context's. The values are compared after the counts are read, and the
+// counts are then set back to zero for the next case.
+static void row(const char *name, SolarContext &ctx, time_t t,
+				unsigned long hits, unsigned long misses){
+	unsigned long h = ctx.getCacheHits(), m = ctx.getCacheMisses();
+	bool ok = h == hits && m == misses && sameAsFresh(ctx, t);
+	printf("| %-34s | %4lu | %6lu | %-4s |\n", name, h, m,
+		   ok ? "ok" : "FAIL");
+	if (!ok) failures++;
+	ctx.resetCacheStats();
+}
+
+int main(){
+	const time_t t = 1718900000;	// 2024-06-20, mid afternoon in Monterey
+	SolarContext ctx((int)sites[0][0], sites[0][1], sites[0][2]);
+	printf("| Case                               | Hits | Misses | Ok   |\n");
+	printf("|------------------------------------|------|--------|------|\n");
+
+	// The first call works out everything the corrected elevation depends
+	// on, which covers every extractor after it
+	ctx.getSEC_Corr(t);
+	ctx.getSZA(t);
+	ctx.getSEA(t);
+	ctx.getAAR(t);
+	ctx.getHA(t);
+	ctx.getSDec(t);
+	ctx.getEOT(t);
+	row("Same t, seven extractors", ctx, t, 6, 1);
+
+	// The declination only needs the ephemeris, so the azimuth after it has
+	// stages of its own to run
+	SolarContext cheap((int)sites[0][0], sites[0][1], sites[0][2]);
+	cheap.getSDec(t);
+	cheap.getSAA(t);
+	cheap.getSDec(t);
+	cheap.getSAA(t);
+	row("Same t, declination then azimuth", cheap, t, 2, 2);
+
+	ctx.getSEC_Corr(t);
+	ctx.getSEC_Corr(t + 1);
+	ctx.getSEC_Corr(t + 1);
+	row("t changes by a second", ctx, t + 1, 2, 1);
+
+	ctx.getSEC_Corr(t + 1);
+	ctx.init((int)sites[2][0], sites[2][1], sites[2][2]);
+	ctx.getSEC_Corr(t + 1);
+	ctx.getSEC_Corr(t + 1);
+	row("Site changes with init()", ctx, t + 1, 2, 1);
+
+	ctx.getSEC_Corr(t + 1);
+	ctx.setTier(SOLAR_TIER_FINE);
+	ctx.getSEC_Corr(t + 1);
+	ctx.getSEC_Corr(t + 1);
+	row("Tier changes with setTier()", ctx, t + 1, 2, 1);
+
+	ctx.getSEC_Corr(t + 1);
+	ctx.setTier(SOLAR_TIER_FINE);
+	ctx.getSEC_Corr(t + 1);
+	row("setTier() to the same tier", ctx, t + 1, 2, 0);
+
+	if (failures) {
+		printf("\n%d cases failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,149 @@
+/* cheb.cpp
+ * Check the Chebyshev fit of SolarChebyshev against the full ephemeris of
+ * calcSolarEphemerisMillis() over 1901 to 2099, and time the two. Also
+ * times calcSolarBatch() with and without the fit, on the scalar engine as
+ * on a board with no vectorized kernel, and on the kernel, which must take
+ * the ephemeris from the fit as the scalar engine does. Runs on a desktop
+ * machine, not on an Arduino. Build from this directory:
+ *
+ * 		g++ -O2 -I../.. cheb.cpp ../../Solarlib.cpp ../../SolarKernel.cpp \
+ * 			-o cheb
+ * 		./cheb
+ *
+ * The output is the tables found in README.md. Exits with 1 if the
+ * kernel's results with the fit differ from the scalar engine's.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Solarlib.h"
+
+static double absd(double x){
+	return x < 0 ? -x : x;
+}
+
+// Difference between two angles in degrees, allowing for the wrap at 360
+static double angleDiff(double a, double b){
+	double d = absd(a - b);
+	while (d > 180) d = absd(d - 360);
+	return d;
+}
+
+int main(){
+	SolarChebyshev fit;
+	clock_t c0 = clock();
+	if (!fit.fit()) {
+		printf("out of memory\n");
+		return 1;
+	}
+	double fitSec = (double)(clock() - c0) / CLOCKS_PER_SEC;
+	long segments = (fit.lastDay() - fit.firstDay()) / SOLAR_CHEB_DAYS + 1;
+	printf("%d terms per value, %ld segments of %d days, %lu bytes, fitted "
+		   "in %.1f ms\n\n", SOLAR_CHEB_TERMS, segments, SOLAR_CHEB_DAYS,
+		   (unsigned long)(segments * 3 * SOLAR_CHEB_TERMS * sizeof(double)),
+		   fitSec * 1e3);
+	// 1901-01-01 to 2099-12-31, stepping by an odd interval with a fraction
+	// of a second so the samples drift through every time of day
+	const int64_t start = SOLAR_FIRST_DAY * 86400000LL;
+	const int64_t end = (SOLAR_LAST_DAY + 1) * 86400000LL;
+	const int64_t step = (3 * 3600 + 13 * 60) * 1000LL + 137;
+	double decErr = 0, eotErr = 0, srvErr = 0, elevErr = 0, azimErr = 0;
+	long samples = 0;
+	SolarSite site;
+	initSolarSite(site, 0, 51.48, 0.0);
+	for (int64_t t = start; t < end; t += step) {
+		SolarEphemeris E, F;
+		calcSolarEphemerisMillis(t, E);
+		fit.eval(t, F);
+		double e;
+		e = absd(F.SDec - E.SDec);
+		if (e > decErr) decErr = e;
+		e = absd(F.EOT - E.EOT);
+		if (e > eotErr) eotErr = e;
+		e = absd(F.SRV - E.SRV);
+		if (e > srvErr) srvErr = e;
+		SolarPosition P, Q;
+		calcSolarPosition(E, site, P);
+		calcSolarPosition(F, site, Q);
+		e = absd(Q.SEA - P.SEA);
+		if (e > elevErr) elevErr = e;
+		if (P.SEA > -89 && P.SEA < 89) {
+			e = angleDiff(Q.SAA, P.SAA);
+			if (e > azimErr) azimErr = e;
+		}
+		samples++;
+	}
+	printf("%ld samples, largest difference from calcSolarEphemerisMillis()"
+		   "\n\n", samples);
+	printf("| SDec deg | EOT min  | SRV AU   | SEA deg  | SAA deg  |\n");
+	printf("|----------|----------|----------|----------|----------|\n");
+	printf("| %8.1e | %8.1e | %8.1e | %8.1e | %8.1e |\n\n", decErr, eotErr,
+		   srvErr, elevErr, azimErr);
+	// Time the ephemeris alone, then a batch on the scalar engine
+	const size_t n = 1000000;
+	int64_t *times = (int64_t *)malloc(n * sizeof(int64_t));
+	for (size_t i = 0; i < n; i++) times[i] = 1704067200000LL + i * 60000LL;
+	double check = 0;
+	c0 = clock();
+	for (size_t i = 0; i < n; i++) {
+		SolarEphemeris E;
+		calcSolarEphemerisMillis(times[i], E);
+		check += E.SDec;
+	}
+	clock_t c1 = clock();
+	for (size_t i = 0; i < n; i++) {
+		SolarEphemeris E;
+		fit.eval(times[i], E);
+		check += E.SDec;
+	}
+	clock_t c2 = clock();
+	if (check != check) printf("NaN\n");
+	printf("| Ephemeris                  | Time    |\n");
+	printf("|----------------------------|---------|\n");
+	printf("| calcSolarEphemerisMillis() | %4.0f ns |\n",
+		   (double)(c1 - c0) / CLOCKS_PER_SEC * 1e9 / n);
+	printf("| SolarChebyshev::eval()     | %4.0f ns |\n",
+		   (double)(c2 - c1) / CLOCKS_PER_SEC * 1e9 / n);
+	initSolarCalc(-8, 36.62, -121.904);
+	SolarColumns cols(n, SOLAR_COL_SDEC | SOLAR_COL_SEC_CORR | SOLAR_COL_SAA);
+	SolarColumns ref(n, SOLAR_COL_SDEC | SOLAR_COL_SEC_CORR | SOLAR_COL_SAA);
+	setSolarKernel("scalar");
+	c0 = clock();
+	calcSolarBatch(times, n, cols);
+	c1 = clock();
+	calcSolarBatch(times, n, ref, &fit);
+	c2 = clock();
+	setSolarKernel(0);
+	printf("| calcSolarBatch(), scalar   | %4.0f ns |\n",
+		   (double)(c1 - c0) / CLOCKS_PER_SEC * 1e9 / n);
+	printf("| the same, with the fit     | %4.0f ns |\n",
+		   (double)(c2 - c1) / CLOCKS_PER_SEC * 1e9 / n);
+	// The same on the vectorized kernel, whose results with the fit should
+	// be those of the scalar engine with the fit
+	c0 = clock();
+	calcSolarBatch(times, n, cols);
+	c1 = clock();
+	calcSolarBatch(times, n, cols, &fit);
+	c2 = clock();
+	printf("| calcSolarBatch(), %-8s | %4.0f ns |\n", getSolarKernel(),
+		   (double)(c1 - c0) / CLOCKS_PER_SEC * 1e9 / n);
+	printf("| the same, with the fit     | %4.0f ns |\n",
+		   (double)(c2 - c1) / CLOCKS_PER_SEC * 1e9 / n);
+	const SolarBatchOut &k = cols.out(), &r = ref.out();
+	double decDiff = 0, corrDiff = 0, azimDiff = 0;
+	for (size_t i = 0; i < n; i++) {
+		double e = absd(k.SDec[i] - r.SDec[i]);
+		if (e > decDiff) decDiff = e;
+		e = absd(k.SEC_Corr[i] - r.SEC_Corr[i]);
+		if (e > corrDiff) corrDiff = e;
+		e = angleDiff(k.SAA[i], r.SAA[i]);
+		if (e > azimDiff) azimDiff = e;
+	}
+	printf("\n| Kernel  | SDec deg | Corr deg | SAA deg  |\n");
+	printf("|---------|----------|----------|----------|\n");
+	printf("| %-7s | %8.1e | %8.1e | %8.1e |\n", getSolarKernel(), decDiff,
+		   corrDiff, azimDiff);
+	free(times);
+	// The kernel must take the declination from the fit
+	return decDiff > 1e-12 || corrDiff > 1e-9 || azimDiff > 1e-9;
+}
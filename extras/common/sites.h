@@ -0,0 +1,34 @@
+/* sites.h
+ * The sites and helpers shared by the check programs in extras/. Each
+ * program includes it as "../common/sites.h", so nothing more is needed on
+ * the build line.
+ */
+#ifndef SolarExtrasSites_h
+#define SolarExtrasSites_h
+
+// Sites spread over the +/- 72 degree latitude range the library supports
+static const double sites[][3] = {
+	// tzOffset, lat, lon
+	{ -8, 36.62, -121.904 },	// Monterey, California
+	{ 0, 51.48, 0.0 },			// Greenwich
+	{ 1, 69.65, 18.96 },		// Tromso
+	{ 10, -33.86, 151.21 },		// Sydney
+	{ -3, -54.80, -68.30 },		// Ushuaia
+	{ 0, 0.0, 0.0 },			// equator
+	{ 9, 71.5, 128.9 },			// near the northern limit
+	{ -5, -71.5, -75.0 }		// near the southern limit
+};
+#define NSITES (sizeof(sites)/sizeof(sites[0]))
+
+static inline double absd(double x){
+	return x < 0 ? -x : x;
+}
+
+// Difference between two angles in degrees, allowing for the wrap at 360
+static inline double angleDiff(double a, double b){
+	double d = absd(a - b);
+	while (d > 180) d = absd(d - 360);
+	return d;
+}
+
+#endif
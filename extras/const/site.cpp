@@ -0,0 +1,109 @@
+/* site.cpp
+ * Check calcSolarSite() and calcSolarDaySite() for a FixedSite, whose
+ * latitude trig is worked out by the compiler, against calcSolarMillis() and
+ * calcSolarDay() for the same site prepared at run time by initSolarSite().
+ * Covers the eight sites in ../common/sites.h, one sample every 7 h 13 min
+ * from 1901 to 2099 and every day of the same span. Runs on a desktop
+ * machine, not on an Arduino. Needs C++14. Build from this directory:
+ *
+ * 		g++ -std=c++14 -O2 -I../.. site.cpp ../../Solarlib.cpp \
+ * 			../../SolarKernel.cpp -o site
+ * 		./site
+ *
+ * The output is the table found in README.md. Exits with 1 if any angle
+ * differs by 1e-9 degree or more, or any time by a millisecond or more.
+ */
+#include <stdio.h>
+#include "Solarlib.h"
+#include "SolarConst.h"
+#include "../common/sites.h"
+
+// The sites of sites.h, with latitude and longitude in millionths of a
+// degree
+typedef FixedSite<36620000, -121904000, -8> Monterey;
+typedef FixedSite<51480000, 0, 0> Greenwich;
+typedef FixedSite<69650000, 18960000, 1> Tromso;
+typedef FixedSite<-33860000, 151210000, 10> Sydney;
+typedef FixedSite<-54800000, -68300000, -3> Ushuaia;
+typedef FixedSite<0, 0, 0> Equator;
+typedef FixedSite<71500000, 128900000, 9> North;
+typedef FixedSite<-71500000, -75000000, -5> South;
+
+static double worstAngle = 0, worstMs = 0;
+
+// Compare Site with the same site prepared at run time, and print a table
+// row of the largest differences
+template <class Site>
+static void checkSite(const char *name){
+	SolarSite site;
+	initSolarSite(site, Site::tzOffset(), Site::lat(), Site::lon());
+	// The prepared values themselves
+	double trigErr = absd(Site::sinLat() - site.sinLat());
+	double e = absd(Site::cosLat() - site.cosLat());
+	if (e > trigErr) trigErr = e;
+	e = absd(Site::tanLat() - site.tanLat());
+	if (e > trigErr) trigErr = e;
+	double elevErr = 0, azimErr = 0, haErr = 0;
+	const int64_t start = -2177452800LL;
+	const int64_t end = 4102358400LL;
+	for (int64_t t = start; t < end; t += 7 * 3600 + 13 * 60) {
+		SolarElements F = SolarElements(), R = SolarElements();
+		calcSolarSite<Site>((time_t)t, F);
+		calcSolarMillis(t * 1000, site, R);
+		e = angleDiff(F.HA, R.HA);
+		if (e > haErr) haErr = e;
+		e = absd(F.SEC_Corr - R.SEC_Corr);
+		if (e > elevErr) elevErr = e;
+		if (R.SEA > -89 && R.SEA < 89) {
+			e = angleDiff(F.SAA, R.SAA);
+			if (e > azimErr) azimErr = e;
+		}
+	}
+	double hasErr = 0, riseMs = 0;
+	for (long days = start / 86400; days < end / 86400; days++) {
+		SolarDay F, R;
+		calcSolarDaySite<Site>(days, F);
+		calcSolarDay(days, site, R);
+		// Polar night and midnight sun give NaN in both
+		if (R.HAS != R.HAS) {
+			if (F.HAS == F.HAS) hasErr = 999;
+			continue;
+		}
+		e = absd(F.HAS - R.HAS);
+		if (e > hasErr) hasErr = e;
+		e = absd(F.Sunrise - R.Sunrise) * 1000;
+		if (e > riseMs) riseMs = e;
+		e = absd(F.Sunset - R.Sunset) * 1000;
+		if (e > riseMs) riseMs = e;
+	}
+	printf("| %-9s | %8.1e | %8.1e | %8.1e | %8.1e | %8.1e | %8.1e |\n", name,
+		   trigErr, haErr, elevErr, azimErr, hasErr, riseMs);
+	double angle = trigErr;
+	if (haErr > angle) angle = haErr;
+	if (elevErr > angle) angle = elevErr;
+	if (azimErr > angle) angle = azimErr;
+	if (hasErr > angle) angle = hasErr;
+	if (angle > worstAngle) worstAngle = angle;
+	if (riseMs > worstMs) worstMs = riseMs;
+}
+
+int main(){
+	printf("| Site      | Trig     | HA deg   | Corr deg | SAA deg  | HAS deg  "
+		   "| Rise ms  |\n");
+	printf("|-----------|----------|----------|----------|----------|----------"
+		   "|----------|\n");
+	checkSite<Monterey>("Monterey");
+	checkSite<Greenwich>("Greenwich");
+	checkSite<Tromso>("Tromso");
+	checkSite<Sydney>("Sydney");
+	checkSite<Ushuaia>("Ushuaia");
+	checkSite<Equator>("Equator");
+	checkSite<North>("71.5 N");
+	checkSite<South>("71.5 S");
+	if (worstAngle >= 1e-9 || worstMs >= 1) {
+		printf("\nA FixedSite differs from the same site prepared at run "
+			   "time\n");
+		return 1;
+	}
+	return 0;
+}
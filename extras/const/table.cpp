@@ -0,0 +1,123 @@
+/* table.cpp
+ * Check the sunrise, solar noon and sunset tables SolarDayTable builds at
+ * compile time against calcSolarDay() at run time. A static_assert pins one
+ * known day, so a change that moves the compile-time values stops the build;
+ * the rest of the program compares a year of days at the sites with a
+ * sunrise and sunset every day, and a year at each end of 1901-2099. Runs on
+ * a desktop machine, not on an Arduino. Needs C++14. Build from this
+ * directory:
+ *
+ * 		g++ -std=c++14 -O2 -I../.. table.cpp ../../Solarlib.cpp \
+ * 			../../SolarKernel.cpp -o table
+ * 		./table
+ *
+ * The output is the table found in README.md. Exits with 1 if any time is
+ * out by a second or more.
+ */
+#include <stdio.h>
+#include "Solarlib.h"
+#include "SolarConst.h"
+#include "../common/sites.h"
+
+// Monterey, California on 2024-06-20 (day 19894): sunrise 04:49:24, noon
+// 12:09:23 and sunset 19:29:22 PST, from calcSolarDay()
+constexpr SolarDayTable<1> june20(19894, -8, 36.62, -121.904);
+static_assert(june20.sunrise[0] >= 1718858963 &&
+			  june20.sunrise[0] <= 1718858965, "sunrise moved");
+static_assert(june20.noon[0] >= 1718885362 && june20.noon[0] <= 1718885364,
+			  "solar noon moved");
+static_assert(june20.sunset[0] >= 1718911761 &&
+			  june20.sunset[0] <= 1718911763, "sunset moved");
+
+// A year of days from 2024-01-01 at the sites in sites.h that have a sunrise
+// and sunset every day, and at Monterey in 1901 and 2099
+#define YEAR 366
+static constexpr SolarDayTable<YEAR> monterey(19723, -8, 36.62, -121.904);
+static constexpr SolarDayTable<YEAR> greenwich(19723, 0, 51.48, 0.0);
+static constexpr SolarDayTable<YEAR> sydney(19723, 10, -33.86, 151.21);
+static constexpr SolarDayTable<YEAR> ushuaia(19723, -3, -54.80, -68.30);
+static constexpr SolarDayTable<YEAR> equator(19723, 0, 0.0, 0.0);
+static constexpr SolarDayTable<YEAR> monterey1901(-25202, -8, 36.62,
+												  -121.904);
+static constexpr SolarDayTable<YEAR> monterey2099(47116, -8, 36.62,
+												  -121.904);
+
+// The whole of solarDayConst(), which the tables are copied from, for N days,
+// to compare the times before they are rounded to seconds
+template <int N>
+struct DayValues {
+	SolarDay day[N];
+
+	constexpr DayValues(long firstDay, int tzOffset, double lat, double lon)
+		: day() {
+		for (int i = 0; i < N; i++) {
+			day[i] = solarDayConst(firstDay + i, tzOffset, lat, lon);
+		}
+	}
+};
+static constexpr DayValues<YEAR> montereyDays(19723, -8, 36.62, -121.904);
+
+// Largest difference in seconds between a table and calcSolarDay(), as a
+// table row
+static long checkTable(const char *name, const SolarDayTable<YEAR> &table,
+					   int tzOffset, double lat, double lon){
+	SolarSite site;
+	initSolarSite(site, tzOffset, lat, lon);
+	long noonErr = 0, riseErr = 0, setErr = 0;
+	for (int i = 0; i < YEAR; i++) {
+		SolarDay SD;
+		calcSolarDay(table.firstDay + i, site, SD);
+		long e = (long)absd((double)(table.noon[i] - SD.SolarNoonTime));
+		if (e > noonErr) noonErr = e;
+		e = (long)absd((double)(table.sunrise[i] - SD.SunriseTime));
+		if (e > riseErr) riseErr = e;
+		e = (long)absd((double)(table.sunset[i] - SD.SunsetTime));
+		if (e > setErr) setErr = e;
+	}
+	printf("| %-16s | %6ld | %6ld s | %6ld s | %6ld s |\n", name,
+		   table.firstDay, noonErr, riseErr, setErr);
+	long worst = noonErr > riseErr ? noonErr : riseErr;
+	return worst > setErr ? worst : setErr;
+}
+
+int main(){
+	printf("| Site             | From   | Noon     | Sunrise  | Sunset   |\n");
+	printf("|------------------|--------|----------|----------|----------|\n");
+	long worst = 0, e;
+	e = checkTable("Monterey", monterey, -8, 36.62, -121.904);
+	if (e > worst) worst = e;
+	e = checkTable("Greenwich", greenwich, 0, 51.48, 0.0);
+	if (e > worst) worst = e;
+	e = checkTable("Sydney", sydney, 10, -33.86, 151.21);
+	if (e > worst) worst = e;
+	e = checkTable("Ushuaia", ushuaia, -3, -54.80, -68.30);
+	if (e > worst) worst = e;
+	e = checkTable("Equator", equator, 0, 0.0, 0.0);
+	if (e > worst) worst = e;
+	e = checkTable("Monterey, 1901", monterey1901, -8, 36.62, -121.904);
+	if (e > worst) worst = e;
+	e = checkTable("Monterey, 2099", monterey2099, -8, 36.62, -121.904);
+	if (e > worst) worst = e;
+	// Before rounding, in milliseconds
+	SolarSite site;
+	initSolarSite(site, -8, 36.62, -121.904);
+	double noonMs = 0, riseMs = 0, setMs = 0;
+	for (int i = 0; i < YEAR; i++) {
+		const SolarDay &C = montereyDays.day[i];
+		SolarDay SD;
+		calcSolarDay(C.unixDays, site, SD);
+		double d = absd(C.SolarNoonDays - SD.SolarNoonDays) * 86400000;
+		if (d > noonMs) noonMs = d;
+		d = absd(C.Sunrise - SD.Sunrise) * 1000;
+		if (d > riseMs) riseMs = d;
+		d = absd(C.Sunset - SD.Sunset) * 1000;
+		if (d > setMs) setMs = d;
+	}
+	printf("\nMonterey in 2024 before rounding to seconds: noon within %.1e "
+		   "ms, sunrise %.1e ms, sunset %.1e ms\n", noonMs, riseMs, setMs);
+	if (worst >= 1 || noonMs >= 1 || riseMs >= 1 || setMs >= 1) {
+		printf("\nA table is out by a second, or a time by a millisecond\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,124 @@
+/* ephemeris.cpp
+ * Write an ephemeris file for SolarEphemerisFile, one record per day from
+ * 1901-1-1 to 2099-12-31 (with two days either side, so every time zone
+ * can interpolate to local noon), then map it back in and check
+ * calcSolarDay() with it against calcSolarDay() without it. Runs on a
+ * desktop machine, not on an Arduino. Build from this directory:
+ *
+ * 		g++ -O2 -I../.. ephemeris.cpp ../../Solarlib.cpp \
+ * 			../../SolarKernel.cpp -o ephemeris
+ * 		./ephemeris ephemeris.bin
+ *
+ * The file is written in this machine's byte order. The output is the
+ * table found in README.md.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Solarlib.h"
+
+static double absd(double x){
+	return x < 0 ? -x : x;
+}
+
+// Write days firstDay to lastDay to path
+static bool writeTable(const char *path, long firstDay, long lastDay){
+	FILE *f = fopen(path, "wb");
+	if (!f) return false;
+	SolarTableHeader h;
+	initSolarTableHeader(h, firstDay, (unsigned long)(lastDay - firstDay + 1));
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+	for (long d = firstDay; ok && d <= lastDay; d++) {
+		SolarTableRecord r;
+		calcSolarTableRecord(d, r);
+		ok = fwrite(&r, sizeof(r), 1, f) == 1;
+	}
+	return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char **argv){
+	const char *path = argc > 1 ? argv[1] : "ephemeris.bin";
+	clock_t c0 = clock();
+	if (!writeTable(path, SOLAR_FIRST_DAY - 2, SOLAR_LAST_DAY + 2)) {
+		printf("cannot write %s\n", path);
+		return 1;
+	}
+	double writeSec = (double)(clock() - c0) / CLOCKS_PER_SEC;
+	SolarEphemerisFile table;
+	c0 = clock();
+	if (!table.open(path)) {
+		printf("cannot map %s\n", path);
+		return 1;
+	}
+	double openSec = (double)(clock() - c0) / CLOCKS_PER_SEC;
+	printf("%s: %ld records from day %ld, %lu bytes, written in %.0f ms, "
+		   "mapped in %.3f ms\n\n", path, table.size(), table.firstDay(),
+		   (unsigned long)(sizeof(SolarTableHeader) +
+						   table.size() * sizeof(SolarTableRecord)),
+		   writeSec * 1e3, openSec * 1e3);
+	// Every day of the range at sites in every time zone
+	double decErr = 0, eotErr = 0, noonErr = 0, riseErr = 0, setErr = 0;
+	double fullSec = 0, tableSec = 0;
+	long samples = 0;
+	for (int tz = -12; tz <= 14; tz++) {
+		double lat = -60 + (tz + 12) * 4.5;
+		double lon = tz * 15 - 7.3;
+		SolarSite site, fromFile;
+		initSolarSite(site, tz, lat, lon);
+		initSolarSite(fromFile, tz, lat, lon);
+		fromFile.file = &table;
+		// Timing, each on its own
+		SolarDay A, B;
+		double check = 0;
+		c0 = clock();
+		for (long d = SOLAR_FIRST_DAY; d <= SOLAR_LAST_DAY; d++) {
+			calcSolarDay(d, site, A);
+			check += A.SolarNoonDays;
+		}
+		clock_t c1 = clock();
+		for (long d = SOLAR_FIRST_DAY; d <= SOLAR_LAST_DAY; d++) {
+			calcSolarDay(d, fromFile, B);
+			check += B.SolarNoonDays;
+		}
+		clock_t c2 = clock();
+		fullSec += (double)(c1 - c0) / CLOCKS_PER_SEC;
+		tableSec += (double)(c2 - c1) / CLOCKS_PER_SEC;
+		if (check != check) printf("NaN\n");
+		for (long d = SOLAR_FIRST_DAY; d <= SOLAR_LAST_DAY; d++) {
+			calcSolarDay(d, site, A);
+			calcSolarDay(d, fromFile, B);
+			// The values at local noon, from the file and worked out
+			long noonMinutes = 720 - tz * 60L;
+			SolarEphemeris E;
+			calcSolarEphemerisMillis(d * 86400000LL + noonMinutes * 60000LL,
+									 E);
+			double SDec = 0, EOT = 0, SRV = 0;
+			table.noon(d, tz, SDec, EOT, SRV);
+			double e;
+			e = absd(SDec - E.SDec);
+			if (e > decErr) decErr = e;
+			e = absd(EOT - E.EOT);
+			if (e > eotErr) eotErr = e;
+			e = absd(B.SolarNoonDays - A.SolarNoonDays) * 86400;
+			if (e > noonErr) noonErr = e;
+			// Days with a sunrise and sunset
+			if (A.HAS == A.HAS && B.HAS == B.HAS) {
+				e = absd(B.Sunrise - A.Sunrise);
+				if (e > riseErr) riseErr = e;
+				e = absd(B.Sunset - A.Sunset);
+				if (e > setErr) setErr = e;
+			}
+			samples++;
+		}
+	}
+	printf("%ld days at 27 sites, largest difference from calcSolarDay() "
+		   "without the file\n\n", samples);
+	printf("| SDec deg | EOT min  | Noon s   | Sunrise s | Sunset s |\n");
+	printf("|----------|----------|----------|-----------|----------|\n");
+	printf("| %8.1e | %8.1e | %8.1e | %9.1e | %8.1e |\n\n", decErr, eotErr,
+		   noonErr, riseErr, setErr);
+	printf("calcSolarDay(): %.0f ns without the file, %.0f ns with it\n",
+		   fullSec * 1e9 / samples, tableSec * 1e9 / samples);
+	table.close();
+	return 0;
+}
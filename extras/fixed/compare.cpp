@@ -0,0 +1,141 @@
+/* compare.cpp
+ * Check the integer-only calcSolarFixed() and calcSolarFixedDay() against
+ * the double precision calcSolar(), including at the two ends of the 32-bit
+ * time range, and count the processor cycles each takes. Runs on a desktop
+ * machine, not on an Arduino. Build from this directory:
+ * 
+ * 		g++ -O2 -I../.. compare.cpp ../../Solarlib.cpp ../../SolarKernel.cpp \
+ * 			../../SolarFixed.cpp -o compare
+ * 		./compare
+ * 
+ * The output is the table found in README.md.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "Solarlib.h"
+#include "SolarFixed.h"
+#include "../common/sites.h"
+
+// Processor cycles, from the time stamp counter where there is one
+static uint64_t cycles(){
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// Degrees to the nearest millidegree
+static int32_t toMdeg(double x){
+	return (int32_t)(x * 1000 + (x < 0 ? -0.5 : 0.5));
+}
+
+int main(){
+	// 1901-12-14 to 2038-01-18, the range of a 32-bit time value
+	const long start = -2147400000L;
+	const long end = 2147400000L;
+	const long step = 7 * 3600 + 13 * 60;
+	double elevErr = 0, seaErr = 0, azimErr = 0, decErr = 0, riseErr = 0, setErr = 0;
+	long samples = 0;
+	for (unsigned int s = 0; s < NSITES; s++) {
+		SolarContext ctx((int)sites[s][0], sites[s][1], sites[s][2]);
+		SolarFixedSite site;
+		initSolarFixedSite(site, (int)sites[s][0], toMdeg(sites[s][1]),
+						   toMdeg(sites[s][2]));
+		for (long t = start; t < end; t += step) {
+			const SolarElements &SE = ctx.getElements(t);
+			SolarFixedPosition P;
+			calcSolarFixed((int32_t)t, site, P);
+			SolarFixedDay D;
+			calcSolarFixedDay((int32_t)t, site, D);
+			samples++;
+			double e = absd(P.SEC_Corr / 1000.0 - SE.SEC_Corr);
+			if (e > elevErr) elevErr = e;
+			e = absd(P.SEA / 1000.0 - SE.SEA);
+			if (e > seaErr) seaErr = e;
+			double d = absd(P.SDec / 1000.0 - SE.SDec);
+			if (d > decErr) decErr = d;
+			if (SE.SEA > 0 && SE.SEA < 89) {
+				double a = absd(P.SAA / 1000.0 - SE.SAA);
+				if (a > 180) a = 360 - a;
+				if (a > azimErr) azimErr = a;
+			}
+			if (SE.HAS == SE.HAS) {
+				double r = absd((double)D.SunriseTime - SE.Sunrise);
+				if (r > riseErr) riseErr = r;
+				r = absd((double)D.SunsetTime - SE.Sunset);
+				if (r > setErr) setErr = r;
+			}
+		}
+	}
+	printf("%ld samples, errors relative to double calcSolar()\n\n", samples);
+	printf("| Value                 | Largest error |\n");
+	printf("|-----------------------|---------------|\n");
+	printf("| Elevation             | %.4f deg    |\n", seaErr);
+	printf("| Elevation (corrected) | %.4f deg    |\n", elevErr);
+	printf("| Azimuth               | %.4f deg    |\n", azimErr);
+	printf("| Declination           | %.4f deg    |\n", decErr);
+	printf("| Sunrise               | %.1f s         |\n", riseErr);
+	printf("| Sunset                | %.1f s         |\n", setErr);
+
+	// The first and last few days of the 32-bit range, in the time zones
+	// furthest from GMT, where local times and the day's times run past it
+	double endErr = 0;
+	long outside = 0, endWrong = 0;
+	static const int zones[] = { -12, 0, 14 };
+	static const long ends[] = { INT32_MIN, INT32_MIN + 86400L,
+								 INT32_MAX - 86400L, INT32_MAX };
+	for (unsigned int z = 0; z < sizeof(zones)/sizeof(zones[0]); z++) {
+		SolarContext ctx(zones[z], sites[1][1], sites[1][2]);
+		SolarFixedSite site;
+		initSolarFixedSite(site, zones[z], toMdeg(sites[1][1]),
+						   toMdeg(sites[1][2]));
+		for (unsigned int k = 0; k < sizeof(ends)/sizeof(ends[0]); k++) {
+			const SolarElements &SE = ctx.getElements(ends[k]);
+			SolarFixedPosition P;
+			calcSolarFixed((int32_t)ends[k], site, P);
+			SolarFixedDay D;
+			calcSolarFixedDay((int32_t)ends[k], site, D);
+			double e = absd(P.SEA / 1000.0 - SE.SEA);
+			if (e > endErr) endErr = e;
+			// Day times past the range are clamped to its ends
+			if (SE.Sunrise < INT32_MIN || SE.Sunset > INT32_MAX) {
+				outside++;
+			} else if (absd((double)D.SunriseTime - SE.Sunrise) > 5 ||
+					   absd((double)D.SunsetTime - SE.Sunset) > 5) {
+				endWrong++;
+			}
+		}
+	}
+	printf("\nAt the ends of the range: elevation within %.4f deg, %ld days "
+		   "with sunrise or sunset out by more than 5 s, %ld days past the "
+		   "range clamped\n", endErr, endWrong, outside);
+
+	// Cycles per call, over the same samples as above for one site
+	SolarFixedSite site;
+	initSolarFixedSite(site, (int)sites[0][0], toMdeg(sites[0][1]),
+					   toMdeg(sites[0][2]));
+	uint32_t check = 0;
+	long calls = 0;
+	uint64_t posCycles = 0, dayCycles = 0;
+	for (long t = start; t < end; t += step) {
+		SolarFixedPosition P;
+		SolarFixedDay D;
+		uint64_t c0 = cycles();
+		calcSolarFixed((int32_t)t, site, P);
+		uint64_t c1 = cycles();
+		calcSolarFixedDay((int32_t)t, site, D);
+		uint64_t c2 = cycles();
+		posCycles += c1 - c0;
+		dayCycles += c2 - c1;
+		check += (uint32_t)P.SEC_Corr + (uint32_t)D.SunriseTime;
+		calls++;
+	}
+	printf("\nCycles per call: calcSolarFixed() %.0f, calcSolarFixedDay() %.0f "
+		   "(check %lu)\n", (double)posCycles / calls,
+		   (double)dayCycles / calls, (unsigned long)check);
+	return endWrong ? 1 : 0;
+}
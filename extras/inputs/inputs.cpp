@@ -0,0 +1,151 @@
+/* inputs.cpp
+ * Check the time inputs against each other: calcSolarMillis(),
+ * calcSolarUnix() and calcSolarJ2000() against calcSolar() at whole seconds,
+ * calcSolarEphemerisMillis() against calcSolarEphemeris(), the three against
+ * each other between whole seconds, and the hour angle against the time that
+ * has passed. Covers 1901 to 2099 at eight sites, before 1970 as well as
+ * after. Runs on a desktop machine, not on an Arduino. Build from this
+ * directory:
+ *
+ * 		g++ -O2 -I../.. inputs.cpp ../../Solarlib.cpp ../../SolarKernel.cpp \
+ * 			-o inputs
+ * 		./inputs
+ *
+ * The output is the table found in README.md. Exits with 1 if any input
+ * differs from the others by 1e-9 degree or a millisecond of sunrise or
+ * more, or the hour angle does not follow the time to within 1e-9 degree.
+ */
+#include <stdio.h>
+#include "Solarlib.h"
+#include "../common/sites.h"
+
+// Seconds from 1970-1-1 00:00 to 2000-1-1 12:00
+#define J2000_UNIX 946728000LL
+
+// Largest differences between two ways of working out the same values
+struct Diff {
+	double dec, eot, ha, corr, azim, rise;
+};
+
+static void addDiff(Diff &d, const SolarElements &a, const SolarElements &b){
+	double e = absd(a.SDec - b.SDec);
+	if (e > d.dec) d.dec = e;
+	e = absd(a.EOT - b.EOT);
+	if (e > d.eot) d.eot = e;
+	e = angleDiff(a.HA, b.HA);
+	if (e > d.ha) d.ha = e;
+	e = absd(a.SEC_Corr - b.SEC_Corr);
+	if (e > d.corr) d.corr = e;
+	if (b.SEA > -89 && b.SEA < 89) {
+		e = angleDiff(a.SAA, b.SAA);
+		if (e > d.azim) d.azim = e;
+	}
+	if (b.HAS == b.HAS) {
+		e = absd(a.Sunrise - b.Sunrise);
+		if (e > d.rise) d.rise = e;
+	}
+}
+
+// The same for the ephemeris alone, with the time of day as the angle the
+// Earth turns through
+static void addDiff(Diff &d, const SolarEphemeris &a, const SolarEphemeris &b){
+	double e = absd(a.SDec - b.SDec);
+	if (e > d.dec) d.dec = e;
+	e = absd(a.EOT - b.EOT);
+	if (e > d.eot) d.eot = e;
+	e = absd(a.utcMinutes - b.utcMinutes) / 4;
+	if (e > d.ha) d.ha = e;
+}
+
+static double worst = 0, worstRise = 0;
+
+// Print a table row, keeping the largest angle and time for the exit status
+static void row(const char *name, const Diff &d){
+	printf("| %-30s | %8.1e | %8.1e | %8.1e | %8.1e | %8.1e | %8.1e |\n",
+		   name, d.dec, d.eot, d.ha, d.corr, d.azim, d.rise);
+	double angles[] = { d.dec, d.ha, d.corr, d.azim };
+	for (unsigned int i = 0; i < sizeof(angles)/sizeof(angles[0]); i++) {
+		if (angles[i] > worst) worst = angles[i];
+	}
+	if (d.rise > worstRise) worstRise = d.rise;
+}
+
+static Diff fromMillis, fromUnix, fromJ2000, before, half, halfJ, ephemeris;
+static double haStep = 0;
+
+// Compare the inputs at t, and at a fraction of a second after it, for site
+static void compareAt(int64_t t, const SolarElements &site){
+	SolarElements T = site, M = site, U = site, J = site;
+	// Whole seconds: all four the same
+	calcSolar((time_t)t, T);
+	calcSolarMillis(t * 1000, M);
+	calcSolarUnix((double)t, U);
+	calcSolarJ2000((double)(t - J2000_UNIX), J);
+	addDiff(fromMillis, M, T);
+	addDiff(fromUnix, U, T);
+	addDiff(fromJ2000, J, T);
+	if (t < 0) addDiff(before, M, T);
+	SolarEphemeris ET, EM;
+	calcSolarEphemeris((time_t)t, ET);
+	calcSolarEphemerisMillis(t * 1000, EM);
+	addDiff(ephemeris, EM, ET);
+	// A quarter or three quarters of a second later, where calcSolar() cannot
+	// go. Before 1970 this is still the day of t, not the day after.
+	int64_t ms = t * 1000 + ((t & 1) ? 250 : 750);
+	calcSolarMillis(ms, M);
+	calcSolarUnix(ms / 1000.0, U);
+	calcSolarJ2000((ms - J2000_UNIX * 1000) / 1000.0, J);
+	addDiff(half, M, U);
+	addDiff(halfJ, J, U);
+	// The hour angle moves on 15 degrees an hour, less the tiny change in
+	// the equation of time over the fraction of a second. The hour angle
+	// wraps at 180 degrees.
+	double moved = (M.HA - T.HA) - (M.EOT - T.EOT) / 4;
+	if (moved > 180) moved -= 360;
+	if (moved < -180) moved += 360;
+	double expected = (ms - t * 1000) * 360.0 / 86400000;
+	double e = absd(moved - expected);
+	if (e > haStep) haStep = e;
+}
+
+int main(){
+	// 1901-01-01 to 2099-12-31, stepping by an odd number of seconds so the
+	// samples fall at every second of the minute
+	const int64_t start = -2177452800LL;
+	const int64_t end = 4102358400LL;
+	const int64_t step = 7 * 3600 + 13 * 60 + 7;
+	// The last and first seconds of the days either side of 1970-1-1
+	const int64_t edges[] = { -86401, -86400, -1, 0, 86399, 86400 };
+	for (unsigned int s = 0; s < NSITES; s++) {
+		SolarElements site;
+		site.tzOffset = (int)sites[s][0];
+		site.lat = sites[s][1];
+		site.lon = sites[s][2];
+		for (int64_t t = start; t < end; t += step) {
+			compareAt(t, site);
+		}
+		for (unsigned int i = 0; i < sizeof(edges)/sizeof(edges[0]); i++) {
+			compareAt(edges[i], site);
+		}
+	}
+	printf("| Inputs compared                | SDec deg | EOT min  | HA deg   "
+		   "| Corr deg | SAA deg  | Rise s   |\n");
+	printf("|--------------------------------|----------|----------|----------"
+		   "|----------|----------|----------|\n");
+	row("calcSolarMillis(), calcSolar()", fromMillis);
+	row("  the same, before 1970", before);
+	row("calcSolarUnix(), calcSolar()", fromUnix);
+	row("calcSolarJ2000(), calcSolar()", fromJ2000);
+	row("Ephemeris Millis(), time_t", ephemeris);
+	row("Millis(), Unix(), fraction", half);
+	row("J2000(), Unix(), fraction", halfJ);
+	printf("\nHour angle after a fraction of a second: within %.1e deg of the "
+		   "time passed\n", haStep);
+	if (haStep > worst) worst = haStep;
+	if (worst >= 1e-9 || worstRise >= 1e-3) {
+		printf("\nThe inputs differ by %.1e deg, or %.1e s\n", worst,
+			   worstRise);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,239 @@
+/* kernel.cpp
+ * Check the block kernel used by calcSolarBatch() against calcSolarMillis(),
+ * which runs the scalar engine, and time the two. Each kernel variant this
+ * machine can run is checked in turn, not only the one getSolarKernel()
+ * picks. The fleet and raster kernels behind calcSolarFleet() and
+ * calcSolarRaster() are checked the same way against calcSolarPosition().
+ * Exits with 1 if any variant is not faster than the scalar engine, which
+ * means its loops were not vectorized. Runs on a desktop machine, not on an
+ * Arduino. Build from this directory, at -O2 like most builds:
+ *
+ * 		g++ -O2 -I../.. kernel.cpp ../../Solarlib.cpp \
+ * 			../../SolarKernel.cpp -o kernel
+ * 		./kernel
+ *
+ * The output is the table found in README.md.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Solarlib.h"
+#include "SolarKernel.h"
+#include "../common/sites.h"
+
+// Check the kernel in use against calcSolarMillis(), and print a table row.
+// Returns false if the kernel is not the faster.
+static bool checkKernel(const int64_t *times, size_t n,
+						const SolarBatchOut &out){
+	double decErr = 0, eotErr = 0, haErr = 0, elevErr = 0, corrErr = 0;
+	double azimErr = 0;
+	double batchSec = 0, scalarSec = 0;
+	long samples = 0;
+	for (unsigned int s = 0; s < NSITES; s++) {
+		SolarSite site;
+		initSolarSite(site, (int)sites[s][0], sites[s][1], sites[s][2]);
+		clock_t c0 = clock();
+		solarKernelPositions(times, n, site, out);
+		clock_t c1 = clock();
+		SolarElements SE;
+		SE.tzOffset = (int)sites[s][0];
+		SE.lat = sites[s][1];
+		SE.lon = sites[s][2];
+		double check = 0;
+		for (size_t i = 0; i < n; i++) {
+			calcSolarMillis(times[i], SE, SOLAR_REFRACTION | SOLAR_AZIMUTH);
+			check += SE.SEC_Corr;
+		}
+		clock_t c2 = clock();
+		batchSec += (double)(c1 - c0) / CLOCKS_PER_SEC;
+		scalarSec += (double)(c2 - c1) / CLOCKS_PER_SEC;
+		if (check != check) printf("scalar engine gave NaN\n");
+		for (size_t i = 0; i < n; i++) {
+			calcSolarMillis(times[i], SE);
+			double e;
+			e = absd(out.SDec[i] - SE.SDec);
+			if (e > decErr) decErr = e;
+			e = absd(out.EOT[i] - SE.EOT);
+			if (e > eotErr) eotErr = e;
+			e = angleDiff(out.HA[i], SE.HA);
+			if (e > haErr) haErr = e;
+			e = absd(out.SEA[i] - SE.SEA);
+			if (e > elevErr) elevErr = e;
+			e = absd(out.SEC_Corr[i] - SE.SEC_Corr);
+			if (e > corrErr) corrErr = e;
+			// Azimuth is poorly defined straight up and straight down
+			if (SE.SEA > -89 && SE.SEA < 89) {
+				e = angleDiff(out.SAA[i], SE.SAA);
+				if (e > azimErr) azimErr = e;
+			}
+			samples++;
+		}
+	}
+	printf("| %-7s | %8.1e | %8.1e | %8.1e | %8.1e | %8.1e | %8.1e | %5.0f ns "
+		   "| %5.0f ns |\n", getSolarKernel(), decErr, eotErr, haErr, elevErr,
+		   corrErr, azimErr, batchSec * 1e9 / samples,
+		   scalarSec * 1e9 / samples);
+	return batchSec < scalarSec;
+}
+
+// Check calcSolarFleet() with the kernel in use against calcSolarPosition()
+// for a registry of sites, and print a table row. Returns false if the
+// kernel is not the faster.
+static bool checkFleet(const SolarSiteRegistry &fleet, SolarColumns &cols){
+	// The same sites prepared for calcSolarPosition()
+	SolarSite *sites = (SolarSite *)malloc(fleet.size() * sizeof(SolarSite));
+	for (size_t i = 0; i < fleet.size(); i++) {
+		initSolarSite(sites[i], fleet.tzOffset()[i], fleet.lat()[i],
+					  fleet.lon()[i]);
+	}
+	const int64_t start = -2177452800000LL;
+	const int64_t step = 97 * 86400000LL + 3 * 3600000LL + 17;
+	const int instants = 400;
+	double elevErr = 0, azimErr = 0;
+	double fleetSec = 0, scalarSec = 0;
+	for (int k = 0; k < instants; k++) {
+		int64_t ms = start + k * step;
+		clock_t c0 = clock();
+		calcSolarFleet(ms, fleet, cols);
+		clock_t c1 = clock();
+		SolarEphemeris E;
+		calcSolarEphemerisMillis(ms, E);
+		SolarPosition P;
+		double check = 0;
+		for (size_t i = 0; i < fleet.size(); i++) {
+			calcSolarPosition(E, sites[i], P);
+			check += P.SEC_Corr;
+		}
+		clock_t c2 = clock();
+		fleetSec += (double)(c1 - c0) / CLOCKS_PER_SEC;
+		scalarSec += (double)(c2 - c1) / CLOCKS_PER_SEC;
+		if (check != check) printf("scalar engine gave NaN\n");
+		for (size_t i = 0; i < fleet.size(); i++) {
+			calcSolarPosition(E, sites[i], P);
+			double e = absd(cols.out().SEC_Corr[i] - P.SEC_Corr);
+			if (e > elevErr) elevErr = e;
+			if (P.SEA > -89 && P.SEA < 89) {
+				e = angleDiff(cols.out().SAA[i], P.SAA);
+				if (e > azimErr) azimErr = e;
+			}
+		}
+	}
+	double samples = (double)instants * fleet.size();
+	printf("| %-7s | %8.1e | %8.1e | %5.0f ns | %5.0f ns |\n",
+		   getSolarKernel(), elevErr, azimErr, fleetSec * 1e9 / samples,
+		   scalarSec * 1e9 / samples);
+	free(sites);
+	return fleetSec < scalarSec;
+}
+
+// Check calcSolarRaster() with the kernel in use against calcSolarPosition()
+// over a quarter degree world map, and print a table row. Returns the time
+// per point.
+static double checkRaster(const SolarGrid &grid, SolarColumns &cols,
+						uint8_t *daylight){
+	const int64_t start = -2177452800000LL;
+	const int64_t step = 1999 * 86400000LL + 5 * 3600000LL + 17;
+	const int instants = 12;
+	double elevErr = 0, azimErr = 0, rasterSec = 0;
+	long dayErr = 0;
+	for (int k = 0; k < instants; k++) {
+		int64_t ms = start + k * step;
+		clock_t c0 = clock();
+		calcSolarRaster(ms, grid, cols, daylight);
+		rasterSec += (double)(clock() - c0) / CLOCKS_PER_SEC;
+		SolarEphemeris E;
+		calcSolarEphemerisMillis(ms, E);
+		// Every 7th row and 3rd column is enough to find the largest errors
+		for (size_t r = 0; r < grid.rows; r += 7) {
+			for (size_t c = 0; c < grid.cols; c += 3) {
+				size_t i = r * grid.cols + c;
+				SolarPosition P;
+				calcSolarPosition(E, grid.lat0 + r * grid.dLat,
+								  grid.lon0 + c * grid.dLon, P);
+				double e = absd(cols.out().SEC_Corr[i] - P.SEC_Corr);
+				if (e > elevErr) elevErr = e;
+				if (P.SEA > -89 && P.SEA < 89) {
+					e = angleDiff(cols.out().SAA[i], P.SAA);
+					if (e > azimErr) azimErr = e;
+				}
+				if (daylight[i] != (P.SEA > SOLAR_HORIZON)) dayErr++;
+			}
+		}
+	}
+	printf("| %-7s | %8.1e | %8.1e | %8ld | %5.1f ns |\n", getSolarKernel(),
+		   elevErr, azimErr, dayErr,
+		   rasterSec * 1e9 / ((double)instants * grid.rows * grid.cols));
+	return rasterSec / ((double)instants * grid.rows * grid.cols);
+}
+
+int main(){
+	// 1901-01-01 to 2099-12-31 in milliseconds, stepping by an odd interval
+	// with a fraction of a second so the samples drift through every time of
+	// day
+	const int64_t start = -2177452800000LL;
+	const int64_t end = 4102358400000LL;
+	const int64_t step = (7 * 3600 + 13 * 60) * 1000LL + 137;
+	const size_t n = (size_t)((end - start) / step);
+	int64_t *times = (int64_t *)malloc(n * sizeof(int64_t));
+	for (size_t i = 0; i < n; i++) times[i] = start + (int64_t)i * step;
+	SolarColumns cols(n, SOLAR_COL_SDEC | SOLAR_COL_EOT | SOLAR_COL_HA |
+					  SOLAR_COL_SEA | SOLAR_COL_SEC_CORR | SOLAR_COL_SAA);
+	printf("calcSolarBatch() uses the %s kernel on this machine\n\n",
+		   getSolarKernel());
+	printf("%ld samples, largest errors relative to calcSolarMillis(), and "
+		   "time per sample\n\n", (long)n * (long)NSITES);
+	printf("| Kernel  | SDec deg | EOT min  | HA deg   | SEA deg  "
+		   "| Corr deg | SAA deg  | Kernel   | Scalar   |\n");
+	printf("|---------|----------|----------|----------|----------"
+		   "|----------|----------|----------|----------|\n");
+	static const char *const names[] = { "avx512", "avx2", "sse4.2", "native" };
+	// Kernels that were no faster than the scalar engine
+	int slow = 0;
+	for (unsigned int k = 0; k < sizeof(names)/sizeof(names[0]); k++) {
+		if (setSolarKernel(names[k]) && !checkKernel(times, n, cols.out())) {
+			slow++;
+		}
+	}
+	// A fleet of sites on a grid over the supported latitudes, at instants
+	// spread over 1901 to 2007
+	SolarSiteRegistry fleet;
+	for (double lat = -71.5; lat <= 71.5; lat += 1.3) {
+		for (double lon = -179.5; lon < 180; lon += 2.9) {
+			fleet.add((int)(lon / 15), lat, lon);
+		}
+	}
+	SolarColumns fleetCols(fleet.size(), SOLAR_COL_SEC_CORR | SOLAR_COL_SAA);
+	printf("\n%lu sites at 400 instants, calcSolarFleet() against "
+		   "calcSolarPosition()\n\n", (unsigned long)fleet.size());
+	printf("| Kernel  | Corr deg | SAA deg  | Fleet    | Scalar   |\n");
+	printf("|---------|----------|----------|----------|----------|\n");
+	for (unsigned int k = 0; k < sizeof(names)/sizeof(names[0]); k++) {
+		if (setSolarKernel(names[k]) && !checkFleet(fleet, fleetCols)) slow++;
+	}
+	// A quarter degree world map, point centres from 89.875 N to 89.875 S
+	SolarGrid grid = { 89.875, -179.875, -0.25, 0.25, 720, 1440 };
+	SolarColumns map(grid.rows * grid.cols,
+					 SOLAR_COL_SEC_CORR | SOLAR_COL_SAA);
+	uint8_t *daylight = (uint8_t *)malloc(grid.rows * grid.cols);
+	printf("\n%lu by %lu map at 12 instants, calcSolarRaster() against "
+		   "calcSolarPosition()\n\n", (unsigned long)grid.rows,
+		   (unsigned long)grid.cols);
+	printf("| Kernel  | Corr deg | SAA deg  | Day flag | Raster   |\n");
+	printf("|---------|----------|----------|----------|----------|\n");
+	// The scalar fallback comes last, so time it first to compare against
+	setSolarKernel("scalar");
+	double scalarRaster = checkRaster(grid, map, daylight);
+	for (unsigned int k = 0; k < sizeof(names)/sizeof(names[0]); k++) {
+		if (setSolarKernel(names[k]) &&
+			checkRaster(grid, map, daylight) >= scalarRaster) slow++;
+	}
+	free(daylight);
+	setSolarKernel(0);
+	free(times);
+	if (slow) {
+		printf("\n%d kernels were no faster than the scalar engine; their "
+			   "loops were not vectorized\n", slow);
+		return 1;
+	}
+	return 0;
+}
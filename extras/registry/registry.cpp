@@ -0,0 +1,255 @@
+/* registry.cpp
+ * Check SolarSiteRegistry's handles and calcSolarFleet()'s rows. A handle
+ * must stop naming a site once the site is removed, a slot given to a new
+ * site must come with a new generation, and rows moved to keep the arrays
+ * packed must still be found by their handles. A long run of random adds
+ * and removes is checked against a plain list of the sites. calcSolarFleet()
+ * for what is left is then compared row by row with calcSolarPosition() for
+ * the same sites, with each kernel this machine can run. Runs on a desktop
+ * machine, not on an Arduino. Build from this directory:
+ *
+ * 		g++ -O2 -I../.. registry.cpp ../../Solarlib.cpp \
+ * 			../../SolarKernel.cpp -o registry
+ * 		./registry
+ *
+ * The output is the table found in README.md. Exits with 1 if any case
+ * fails, or any angle differs by 1e-9 degree or more.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "Solarlib.h"
+#include "../common/sites.h"
+
+// Handles are a slot number in the low 24 bits and a generation in the top 8
+#define SLOT(h)	((h) & 0x00FFFFFFUL)
+#define GEN(h)	((h) >> 24)
+
+static int failures = 0;
+
+// Print a table row for one case, counting it as a failure if not ok
+static void row(const char *name, bool ok){
+	printf("| %-44s | %-4s |\n", name, ok ? "ok" : "FAIL");
+	if (!ok) failures++;
+}
+
+// Whether h is rejected everywhere a handle is taken
+static bool rejected(SolarSiteRegistry &reg, SolarSiteHandle h){
+	return reg.indexOf(h) == -1 && !reg.contains(h) && !reg.remove(h);
+}
+
+// Whether h finds the row holding the site at lat, lon
+static bool finds(const SolarSiteRegistry &reg, SolarSiteHandle h, int tz,
+				  double lat, double lon){
+	long i = reg.indexOf(h);
+	return i >= 0 && reg.handleAt((size_t)i) == h && reg.tzOffset()[i] == tz &&
+		   reg.lat()[i] == lat && reg.lon()[i] == lon;
+}
+
+// A site as the plain list keeps it
+struct Site {
+	SolarSiteHandle h;
+	int tz;
+	double lat, lon;
+};
+
+// Small fixed-seed generator, so every run does the same adds and removes
+static uint32_t rnd = 2463534242UL;
+static uint32_t next(){
+	rnd ^= rnd << 13;
+	rnd ^= rnd >> 17;
+	rnd ^= rnd << 5;
+	return rnd;
+}
+
+// Random adds and removes, checked after each against list. Returns false at
+// the first difference.
+static bool churn(SolarSiteRegistry &reg, Site *list, size_t &n, size_t max,
+				  SolarSiteHandle *gone, size_t &goneCount, size_t goneMax){
+	for (int k = 0; k < 200000; k++) {
+		if (n < max && (n == 0 || next() % 100 < 52)) {
+			Site s;
+			s.tz = (int)(next() % 27) - 12;
+			s.lat = (double)(next() % 143001) / 1000 - 71.5;
+			s.lon = (double)(next() % 360000) / 1000 - 180;
+			s.h = reg.add(s.tz, s.lat, s.lon);
+			if (s.h == SOLAR_NO_SITE) return false;
+			list[n++] = s;
+		} else {
+			size_t i = next() % n;
+			if (!reg.remove(list[i].h)) return false;
+			if (goneCount < goneMax) gone[goneCount++] = list[i].h;
+			list[i] = list[--n];
+		}
+		if (reg.size() != n) return false;
+		// Spot check a few sites each time, and every site now and then
+		size_t checks = (k % 1000 == 0) ? n : (n < 4 ? n : 4);
+		for (size_t c = 0; c < checks; c++) {
+			const Site &s = list[checks == n ? c : next() % n];
+			if (!finds(reg, s.h, s.tz, s.lat, s.lon)) return false;
+		}
+	}
+	return true;
+}
+
+// Compare calcSolarFleet() with calcSolarPosition() for every site in reg at
+// instants spread over 1901 to 2099, and print a table row. Returns the
+// largest difference.
+static double checkFleet(const SolarSiteRegistry &reg, SolarColumns &cols){
+	double haErr = 0, zenErr = 0, elevErr = 0, corrErr = 0, azimErr = 0;
+	double ephErr = 0;
+	const int64_t start = -2177452800000LL;
+	const int64_t step = 181 * 86400000LL + 5 * 3600000LL + 7001;
+	for (int k = 0; k < 400; k++) {
+		int64_t ms = start + k * step;
+		calcSolarFleet(ms, reg, cols);
+		const SolarBatchOut &out = cols.out();
+		SolarEphemeris E;
+		calcSolarEphemerisMillis(ms, E);
+		for (size_t i = 0; i < reg.size(); i++) {
+			SolarSite site;
+			initSolarSite(site, reg.tzOffset()[i], reg.lat()[i], reg.lon()[i]);
+			SolarPosition P;
+			calcSolarPosition(E, site, P);
+			double e = absd(out.SDec[i] - E.SDec);
+			if (e > ephErr) ephErr = e;
+			e = absd(out.EOT[i] - E.EOT) / 4;
+			if (e > ephErr) ephErr = e;
+			e = angleDiff(out.HA[i], P.HA);
+			if (e > haErr) haErr = e;
+			e = absd(out.SZA[i] - P.SZA);
+			if (e > zenErr) zenErr = e;
+			e = absd(out.SEA[i] - P.SEA);
+			if (e > elevErr) elevErr = e;
+			e = absd(out.SEC_Corr[i] - P.SEC_Corr);
+			if (e > corrErr) corrErr = e;
+			// Azimuth is poorly defined straight up and straight down
+			if (P.SEA > -89 && P.SEA < 89) {
+				e = angleDiff(out.SAA[i], P.SAA);
+				if (e > azimErr) azimErr = e;
+			}
+		}
+	}
+	printf("| %-7s | %8.1e | %8.1e | %8.1e | %8.1e | %8.1e | %8.1e |\n",
+		   getSolarKernel(), ephErr, haErr, zenErr, elevErr, corrErr, azimErr);
+	double worst = ephErr;
+	double errs[] = { haErr, zenErr, elevErr, corrErr, azimErr };
+	for (unsigned int i = 0; i < sizeof(errs)/sizeof(errs[0]); i++) {
+		if (errs[i] > worst) worst = errs[i];
+	}
+	return worst;
+}
+
+int main(){
+	SolarSiteRegistry reg;
+	printf("| Case                                         | Ok   |\n");
+	printf("|----------------------------------------------|------|\n");
+
+	// The sites of sites.h, in rows 0 to 7
+	SolarSiteHandle h[NSITES];
+	for (unsigned int s = 0; s < NSITES; s++) {
+		h[s] = reg.add((int)sites[s][0], sites[s][1], sites[s][2]);
+	}
+	bool ok = reg.size() == NSITES;
+	for (unsigned int s = 0; s < NSITES; s++) {
+		ok = ok && reg.indexOf(h[s]) == (long)s &&
+			 finds(reg, h[s], (int)sites[s][0], sites[s][1], sites[s][2]);
+	}
+	row("Eight sites added, rows in order", ok);
+
+	// Removing row 2 moves the last row into it
+	ok = reg.remove(h[2]) && reg.size() == NSITES - 1;
+	row("Remove a site", ok);
+	row("Its handle is rejected", rejected(reg, h[2]));
+	ok = reg.indexOf(h[NSITES - 1]) == 2;
+	for (unsigned int s = 0; s < NSITES; s++) {
+		if (s == 2) continue;
+		ok = ok && finds(reg, h[s], (int)sites[s][0], sites[s][1], sites[s][2]);
+	}
+	row("The moved last site is found in its new row", ok);
+
+	// The next site takes the free slot, one generation on
+	SolarSiteHandle reused = reg.add(0, 10.0, 20.0);
+	row("A new site reuses the free slot", SLOT(reused) == SLOT(h[2]));
+	row("  with the next generation", GEN(reused) == GEN(h[2]) + 1);
+	row("  and its own handle", finds(reg, reused, 0, 10.0, 20.0));
+	row("The old handle is still rejected", rejected(reg, h[2]));
+
+	// The same slot through many generations: each handle is rejected once
+	// its site is gone, while the site that holds the slot is found. The
+	// generation is 8 bits, so after 256 reuses a handle's value comes round
+	// again; this covers 255.
+	SolarSiteHandle old[255];
+	SolarSiteHandle cur = reused;
+	ok = true;
+	for (int g = 0; g < 255 && ok; g++) {
+		old[g] = cur;
+		ok = reg.remove(cur);
+		cur = reg.add(1, 11.0, 21.0);
+		ok = ok && SLOT(cur) == SLOT(reused) &&
+			 GEN(cur) == ((GEN(reused) + g + 1) & 0xFF) &&
+			 finds(reg, cur, 1, 11.0, 21.0);
+	}
+	row("One slot reused 255 times", ok);
+	for (int g = 0; g < 255 && ok; g++) ok = rejected(reg, old[g]);
+	row("  every old handle rejected", ok);
+
+	// A handle never given out, and SOLAR_NO_SITE
+	row("SOLAR_NO_SITE is rejected", rejected(reg, SOLAR_NO_SITE));
+	row("A slot never handed out is rejected",
+		rejected(reg, (SolarSiteHandle)1000));
+
+	// clear() ends every handle
+	SolarSiteHandle live[NSITES + 1];
+	size_t nLive = 0;
+	for (size_t i = 0; i < reg.size(); i++) live[nLive++] = reg.handleAt(i);
+	reg.clear();
+	ok = reg.size() == 0;
+	for (size_t i = 0; i < nLive; i++) ok = ok && rejected(reg, live[i]);
+	row("clear() rejects every handle", ok);
+
+	// Random adds and removes against a plain list
+	const size_t max = 5000, goneMax = 20000;
+	Site *list = (Site *)malloc(max * sizeof(Site));
+	SolarSiteHandle *gone = (SolarSiteHandle *)
+		malloc(goneMax * sizeof(SolarSiteHandle));
+	size_t n = 0, goneCount = 0;
+	ok = churn(reg, list, n, max, gone, goneCount, goneMax);
+	row("200000 random adds and removes", ok);
+	// Handles of removed sites, unless the slot has since come round to the
+	// same generation, which the 8-bit generation allows after 256 reuses
+	ok = true;
+	for (size_t i = 0; i < goneCount; i++) {
+		bool same = false;
+		for (size_t j = 0; j < n && !same; j++) same = list[j].h == gone[i];
+		ok = ok && (same || rejected(reg, gone[i]));
+	}
+	row("  removed handles rejected", ok);
+
+	// calcSolarFleet() for what is left
+	SolarColumns cols(reg.size(), SOLAR_COL_SDEC | SOLAR_COL_EOT |
+					  SOLAR_COL_HA | SOLAR_COL_SZA | SOLAR_COL_SEA |
+					  SOLAR_COL_SEC_CORR | SOLAR_COL_SAA);
+	printf("\n%lu sites at 400 instants, calcSolarFleet() against "
+		   "calcSolarPosition()\n\n", (unsigned long)reg.size());
+	printf("| Kernel  | Ephem    | HA deg   | SZA deg  | SEA deg  | Corr deg "
+		   "| SAA deg  |\n");
+	printf("|---------|----------|----------|----------|----------|----------"
+		   "|----------|\n");
+	static const char *const names[] = { "avx512", "avx2", "sse4.2", "native",
+										 "scalar" };
+	double worst = 0;
+	for (unsigned int k = 0; k < sizeof(names)/sizeof(names[0]); k++) {
+		if (!setSolarKernel(names[k])) continue;
+		double e = checkFleet(reg, cols);
+		if (e > worst) worst = e;
+	}
+	setSolarKernel(0);
+	free(gone);
+	free(list);
+	if (failures || worst >= 1e-9) {
+		printf("\n%d cases failed, fleet rows differ by up to %.1e deg\n",
+			   failures, worst);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,331 @@
+/* scheduler.cpp
+ * Drive SolarScheduler with a mix of batch, fleet and raster jobs of very
+ * different sizes, and check that every output is the same bit for bit as
+ * calling calcSolarBatch(), calcSolarFleet() and calcSolarRaster() one by
+ * one on a single thread. Runs the queue with several numbers of threads,
+ * so chunks are cut, dealt out and stolen differently each time. Runs on a
+ * desktop machine, not on an Arduino. Needs SOLARLIB_THREADS. Build from
+ * this directory:
+ *
+ * 		g++ -O2 -DSOLARLIB_THREADS -pthread -I../.. scheduler.cpp \
+ * 			../../Solarlib.cpp ../../SolarKernel.cpp -o scheduler
+ * 		./scheduler
+ *
+ * and to look for data races with ThreadSanitizer, which runs several times
+ * slower and reports any race it sees on stderr:
+ *
+ * 		g++ -O1 -g -fsanitize=thread -DSOLARLIB_THREADS -pthread -I../.. \
+ * 			scheduler.cpp ../../Solarlib.cpp ../../SolarKernel.cpp \
+ * 			-o scheduler-tsan
+ * 		./scheduler-tsan
+ *
+ * The output is the table found in README.md. Exits with 1 if any output
+ * differs from the single-threaded one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "Solarlib.h"
+#include "../common/sites.h"
+
+#if !defined(SOLARLIB_THREADS)
+#error Build with -DSOLARLIB_THREADS -pthread
+#endif
+
+#define POSITION_COLS	(SOLAR_COL_SDEC | SOLAR_COL_EOT | SOLAR_COL_HA | \
+						 SOLAR_COL_SZA | SOLAR_COL_SEA | SOLAR_COL_AAR | \
+						 SOLAR_COL_SEC_CORR | SOLAR_COL_SAA)
+#define DAY_COLS		(SOLAR_COL_NOON | SOLAR_COL_SUNRISE | SOLAR_COL_SUNSET)
+
+// Whether every column of a is the same, bit for bit, as that of b
+static bool sameColumns(const SolarColumns &a, const SolarColumns &b){
+	const SolarBatchOut &x = a.out(), &y = b.out();
+	size_t n = a.size();
+	double *const dx[] = { x.SDec, x.EOT, x.HA, x.SZA, x.SEA, x.AAR,
+						   x.SEC_Corr, x.SAA };
+	double *const dy[] = { y.SDec, y.EOT, y.HA, y.SZA, y.SEA, y.AAR,
+						   y.SEC_Corr, y.SAA };
+	for (unsigned int c = 0; c < sizeof(dx)/sizeof(dx[0]); c++) {
+		if (dx[c] && memcmp(dx[c], dy[c], n * sizeof(double))) return false;
+	}
+	time_t *const tx[] = { x.SolarNoonTime, x.SunriseTime, x.SunsetTime };
+	time_t *const ty[] = { y.SolarNoonTime, y.SunriseTime, y.SunsetTime };
+	for (unsigned int c = 0; c < sizeof(tx)/sizeof(tx[0]); c++) {
+		if (tx[c] && memcmp(tx[c], ty[c], n * sizeof(time_t))) return false;
+	}
+	return true;
+}
+
+// Fill every column with a pattern no calculation gives, so a row left
+// unwritten shows up as a difference
+static void poison(SolarColumns &cols){
+	const SolarBatchOut &o = cols.out();
+	double *const d[] = { o.SDec, o.EOT, o.HA, o.SZA, o.SEA, o.AAR,
+						  o.SEC_Corr, o.SAA };
+	for (unsigned int c = 0; c < sizeof(d)/sizeof(d[0]); c++) {
+		if (d[c]) memset(d[c], 0xA5, cols.size() * sizeof(double));
+	}
+	time_t *const t[] = { o.SolarNoonTime, o.SunriseTime, o.SunsetTime };
+	for (unsigned int c = 0; c < sizeof(t)/sizeof(t[0]); c++) {
+		if (t[c]) memset(t[c], 0xA5, cols.size() * sizeof(time_t));
+	}
+}
+
+// Small fixed-seed generator, so every run queues the same work
+static uint32_t rnd = 2463534242UL;
+static uint32_t next(){
+	rnd ^= rnd << 13;
+	rnd ^= rnd >> 17;
+	rnd ^= rnd << 5;
+	return rnd;
+}
+
+// A batch job: a site, its times and the columns asked for
+struct Batch {
+	SolarSite site;
+	int64_t *t;
+	size_t n;
+	const SolarChebyshev *fit;
+	SolarColumns *ref, *out;
+};
+
+// A fleet or raster job at one instant
+struct Instant {
+	int64_t utcMillis;
+	SolarColumns *ref, *out;
+	uint8_t *refDay, *outDay;
+};
+
+#define NBATCH		6
+#define NFLEET		4
+#define NRASTER		27
+
+static Batch batches[NBATCH];
+static Instant fleets[NFLEET], rasters[NRASTER];
+static const SolarSiteRegistry *fleetSites[NFLEET];
+static SolarGrid rasterGrids[NRASTER];
+
+// Times from first to first + span milliseconds, every step, or at random
+// if step is 0
+static int64_t *times(size_t n, int64_t first, int64_t span, int64_t step){
+	int64_t *t = (int64_t *)malloc((n ? n : 1) * sizeof(int64_t));
+	for (size_t i = 0; i < n; i++) {
+		t[i] = step ? first + (int64_t)i * step :
+			   first + (int64_t)((double)next() / 4294967296.0 * span);
+	}
+	return t;
+}
+
+static void addBatch(int k, unsigned int s, int64_t *t, size_t n,
+					 unsigned int columns, const SolarChebyshev *fit){
+	Batch &b = batches[k];
+	initSolarSite(b.site, (int)sites[s][0], sites[s][1], sites[s][2]);
+	b.t = t;
+	b.n = n;
+	b.fit = fit;
+	b.ref = new SolarColumns(n ? n : 1, columns);
+	b.out = new SolarColumns(n ? n : 1, columns);
+}
+
+static void addInstant(Instant &i, int64_t utcMillis, size_t n,
+					   bool daylight){
+	i.utcMillis = utcMillis;
+	i.ref = new SolarColumns(n ? n : 1, POSITION_COLS);
+	i.out = new SolarColumns(n ? n : 1, POSITION_COLS);
+	i.refDay = daylight ? (uint8_t *)malloc(n ? n : 1) : 0;
+	i.outDay = daylight ? (uint8_t *)malloc(n ? n : 1) : 0;
+}
+
+static void freeInstant(Instant &i){
+	delete i.ref;
+	delete i.out;
+	free(i.refDay);
+	free(i.outDay);
+}
+
+// Queue every job, writing to the out columns
+static void queue(SolarScheduler &jobs){
+	for (int k = 0; k < NBATCH; k++) {
+		const Batch &b = batches[k];
+		jobs.addBatch(b.site, b.t, b.n, b.out->out(), b.fit);
+	}
+	for (int k = 0; k < NFLEET; k++) {
+		jobs.addFleet(fleets[k].utcMillis, *fleetSites[k],
+					  fleets[k].out->out());
+	}
+	for (int k = 0; k < NRASTER; k++) {
+		jobs.addRaster(rasters[k].utcMillis, rasterGrids[k],
+					   rasters[k].out->out(), rasters[k].outDay);
+	}
+}
+
+// Poison every out column
+static void clearOutputs(){
+	for (int k = 0; k < NBATCH; k++) poison(*batches[k].out);
+	for (int k = 0; k < NFLEET; k++) poison(*fleets[k].out);
+	for (int k = 0; k < NRASTER; k++) {
+		poison(*rasters[k].out);
+		if (rasters[k].outDay) {
+			memset(rasters[k].outDay, 0xA5, rasters[k].out->size());
+		}
+	}
+}
+
+static int failures = 0;
+
+// Compare the out columns with the reference and print a table row of how
+// many jobs of each kind gave the same output
+static void row(const char *name){
+	int batch = 0, fleet = 0, raster = 0;
+	for (int k = 0; k < NBATCH; k++) {
+		batch += !sameColumns(*batches[k].out, *batches[k].ref);
+	}
+	for (int k = 0; k < NFLEET; k++) {
+		fleet += !sameColumns(*fleets[k].out, *fleets[k].ref);
+	}
+	for (int k = 0; k < NRASTER; k++) {
+		const Instant &r = rasters[k];
+		raster += !sameColumns(*r.out, *r.ref) ||
+				  (r.outDay && memcmp(r.outDay, r.refDay, r.out->size()));
+	}
+	printf("| %-12s | %2d of %2d | %2d of %2d | %2d of %2d |\n", name,
+		   NBATCH - batch, NBATCH, NFLEET - fleet, NFLEET, NRASTER - raster,
+		   NRASTER);
+	failures += batch + fleet + raster;
+}
+
+int main(){
+	// A year of minutes at Monterey with every column; one day at Sydney
+	// with only the per-day columns; scattered times over 1901 to 2099 at
+	// Tromso; a decade at Ushuaia from an ephemeris fit; and two that are
+	// next to nothing
+	const int64_t y2024 = 1704067200000LL;
+	addBatch(0, 0, times(366 * 1440 + 17, y2024, 0, 60000), 366 * 1440 + 17,
+			 SOLAR_COL_ALL, 0);
+	addBatch(1, 3, times(1441, y2024, 0, 60000), 1441, DAY_COLS, 0);
+	addBatch(2, 2, times(30011, -2177452800000LL, 6279811200000LL, 0), 30011,
+			 POSITION_COLS | SOLAR_COL_SUNRISE, 0);
+	SolarChebyshev fit;
+	if (!fit.fit(18262, 21915)) {	// 2020 to 2029
+		printf("Could not fit the ephemeris\n");
+		return 1;
+	}
+	addBatch(3, 4, times(50021, 1577836800000LL, 315532800000LL, 0), 50021,
+			 SOLAR_COL_SEC_CORR | SOLAR_COL_SAA, &fit);
+	addBatch(4, 5, times(5, y2024, 0, 1000), 5, SOLAR_COL_ALL, 0);
+	addBatch(5, 1, times(0, y2024, 0, 1000), 0, SOLAR_COL_ALL, 0);
+
+	// A large fleet at three instants and a fleet of three sites
+	SolarSiteRegistry big, small;
+	for (double lat = -71.5; lat <= 71.5; lat += 1.1) {
+		for (double lon = -179.5; lon < 180; lon += 2.3) {
+			big.add((int)(lon / 15), lat, lon);
+		}
+	}
+	for (unsigned int s = 0; s < 3; s++) {
+		small.add((int)sites[s][0], sites[s][1], sites[s][2]);
+	}
+	for (int k = 0; k < NFLEET; k++) {
+		fleetSites[k] = k < 3 ? &big : &small;
+		addInstant(fleets[k], 1718900000000LL + k * 3600007LL,
+				   fleetSites[k]->size(), false);
+	}
+
+	// A one degree world map every hour of a day, a third of a degree map
+	// with day/night flags, a single row, and rows with no columns
+	for (int k = 0; k < NRASTER; k++) {
+		SolarGrid g = { 89.5, -179.5, -1, 1, 180, 360 };
+		if (k == 24) {
+			SolarGrid fine = { 89.8, -179.8, -1.0 / 3, 1.0 / 3, 539, 1079 };
+			g = fine;
+		} else if (k == 25) {
+			SolarGrid line = { 36.62, -180, 0, 0.1, 1, 3600 };
+			g = line;
+		} else if (k == 26) {
+			SolarGrid empty = { 10, 20, -1, 1, 40, 0 };
+			g = empty;
+		}
+		rasterGrids[k] = g;
+		addInstant(rasters[k], 1718841600000LL + k * 3600000LL,
+				   g.rows * g.cols, k >= 24);
+	}
+
+	// The reference: each function called on its own on one thread
+	setSolarThreads(1);
+	for (int k = 0; k < NBATCH; k++) {
+		const Batch &b = batches[k];
+		poison(*b.ref);
+		initSolarCalc(b.site.tz, b.site.latDeg, b.site.lonDeg);
+		calcSolarBatch(b.t, b.n, b.ref->out(), b.fit);
+	}
+	for (int k = 0; k < NFLEET; k++) {
+		poison(*fleets[k].ref);
+		calcSolarFleet(fleets[k].utcMillis, *fleetSites[k],
+					   fleets[k].ref->out());
+	}
+	for (int k = 0; k < NRASTER; k++) {
+		poison(*rasters[k].ref);
+		if (rasters[k].refDay) {
+			memset(rasters[k].refDay, 0xA5, rasters[k].ref->size());
+		}
+		calcSolarRaster(rasters[k].utcMillis, rasterGrids[k],
+						rasters[k].ref->out(), rasters[k].refDay);
+	}
+
+	printf("%d batch, %d fleet and %d raster jobs; %u cores\n\n", NBATCH,
+		   NFLEET, NRASTER, std::thread::hardware_concurrency());
+	printf("| Threads      | Batch    | Fleet    | Raster   |\n");
+	printf("|--------------|----------|----------|----------|\n");
+	SolarScheduler jobs;
+	static const unsigned int counts[] = { 1, 2, 3, 4, 8, 13, 0 };
+	for (unsigned int k = 0; k < sizeof(counts)/sizeof(counts[0]); k++) {
+		setSolarThreads(counts[k]);
+		clearOutputs();
+		queue(jobs);
+		jobs.run();
+		char name[16];
+		if (counts[k]) {
+			snprintf(name, sizeof(name), "%u", counts[k]);
+		} else {
+			snprintf(name, sizeof(name), "one per core");
+		}
+		if (jobs.pending()) {
+			printf("run() left %lu jobs queued\n",
+				   (unsigned long)jobs.pending());
+			failures++;
+		}
+		row(name);
+	}
+
+	// The queue is reused above; clear() drops jobs without running them
+	setSolarThreads(4);
+	clearOutputs();
+	queue(jobs);
+	jobs.clear();
+	jobs.run();
+	int untouched = 0;
+	for (int k = 0; k < NFLEET; k++) {
+		SolarColumns poisoned(fleets[k].out->size(), POSITION_COLS);
+		poison(poisoned);
+		untouched += sameColumns(*fleets[k].out, poisoned);
+	}
+	printf("\nclear() then run() wrote %s\n",
+		   untouched == NFLEET ? "nothing" : "to the outputs");
+	if (untouched != NFLEET) failures++;
+
+	setSolarThreads(0);
+	for (int k = 0; k < NBATCH; k++) {
+		delete batches[k].ref;
+		delete batches[k].out;
+		free(batches[k].t);
+	}
+	for (int k = 0; k < NFLEET; k++) freeInstant(fleets[k]);
+	for (int k = 0; k < NRASTER; k++) freeInstant(rasters[k]);
+	if (failures) {
+		printf("\n%d outputs differ from the single-threaded ones\n",
+			   failures);
+		return 1;
+	}
+	return 0;
+}
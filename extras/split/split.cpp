@@ -0,0 +1,189 @@
+/* split.cpp
+ * Check solarSplitTime(), which calcSolar() uses to get the day and the
+ * seconds past midnight of a time value, against the two ways of breaking a
+ * time down it replaces: the Time library's hour(), minute() and second(),
+ * and the C library's gmtime(). Covers 1901 to 2099, and every second
+ * either side of midnight and of 1970-1-1 00:00. Then checks
+ * solarSplitMillisDouble(), which the batch kernel uses, against
+ * solarSplitMillis(), before 1970, past 2038 and out to 2^53 ms. Runs on a
+ * desktop machine, not on an Arduino. Build from this directory:
+ *
+ * 		g++ -O2 -I../.. split.cpp ../../Solarlib.cpp ../../SolarKernel.cpp \
+ * 			-o split
+ * 		./split
+ *
+ * The output is the tables found in README.md. Exits with 1 if any time is
+ * split differently from gmtime(), or by the two millisecond splits.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "SolarEngine.h"
+#include "SolarMath.h"
+
+// Seconds past midnight as the Time library works them out: hour(),
+// minute() and second() each break down the time as an unsigned 32-bit
+// count, so times before 1970 wrap round to 2106.
+static long timeLibrarySecs(time_t t){
+	uint32_t u = (uint32_t)t;
+	long second = (long)(u % 60);
+	u /= 60;
+	long minute = (long)(u % 60);
+	u /= 60;
+	long hour = (long)(u % 24);
+	return hour * 3600 + minute * 60 + second;
+}
+
+// Counts of times checked and of those split differently
+struct Tally {
+	long checked;
+	long gmtimeWrong;
+	long timeLibChecked;
+	long timeLibWrong;
+};
+
+// Split t with solarSplitTime() and compare the result with gmtime() and,
+// where t is in its range, with the Time library
+static void check(time_t t, Tally &tally){
+	long days, secs;
+	solarSplitTime(t, days, secs);
+	struct tm tm;
+	gmtime_r(&t, &tm);
+	long gmSecs = tm.tm_hour * 3600L + tm.tm_min * 60 + tm.tm_sec;
+	// The day is right if it starts at midnight of the same calendar date
+	time_t midnight = (time_t)days * 86400;
+	struct tm dayTm;
+	gmtime_r(&midnight, &dayTm);
+	tally.checked++;
+	if (secs != gmSecs || midnight + secs != t || dayTm.tm_hour != 0 ||
+		dayTm.tm_yday != tm.tm_yday || dayTm.tm_year != tm.tm_year) {
+		if (tally.gmtimeWrong++ < 5) {
+			printf("t = %lld: days %ld secs %ld, gmtime %04d-%03d %ld\n",
+				   (long long)t, days, secs, tm.tm_year + 1900, tm.tm_yday,
+				   gmSecs);
+		}
+	}
+	// A 32-bit time value, signed before 1970 or unsigned after
+	if (t >= INT32_MIN && t <= (time_t)UINT32_MAX) {
+		tally.timeLibChecked++;
+		if (secs != timeLibrarySecs(t)) tally.timeLibWrong++;
+	}
+}
+
+// Times checked with the two millisecond splits, and those split
+// differently
+struct MillisTally {
+	long checked;
+	long wrong;
+};
+
+// Split ms with solarSplitMillisDouble() and solarSplitMillis(), and compare
+static void checkMillis(int64_t ms, MillisTally &tally){
+	long days, msOfDay;
+	solarSplitMillis(ms, days, msOfDay);
+	double dDays, dMs;
+	solarSplitMillisDouble<SolarVecMath>(ms, dDays, dMs);
+	tally.checked++;
+	if (dDays != (double)days || dMs != (double)msOfDay) {
+		if (tally.wrong++ < 5) {
+			printf("ms = %lld: days %ld ms %ld, in doubles %.0f %.0f\n",
+				   (long long)ms, days, msOfDay, dDays, dMs);
+		}
+	}
+}
+
+static void millisRow(const char *name, const MillisTally &tally){
+	printf("| %-22s | %9ld | %9ld |\n", name, tally.checked, tally.wrong);
+}
+
+// Print a table row for the times checked in one range
+static void row(const char *name, const Tally &tally){
+	printf("| %-22s | %9ld | %9ld | %9ld |\n", name, tally.checked,
+		   tally.gmtimeWrong, tally.timeLibWrong);
+}
+
+int main(){
+	if (sizeof(time_t) < 8) {
+		printf("needs a 64-bit time_t\n");
+		return 1;
+	}
+	printf("| Times                  | Checked   | gmtime()  | Time lib  |\n");
+	printf("|------------------------|-----------|-----------|-----------|\n");
+	// 1901-01-01 to 2099-12-31, stepping by an odd interval so the samples
+	// drift through every second of the day
+	const time_t start = -2177452800LL;
+	const time_t end = 4102358400LL;
+	const time_t step = 7 * 3600 + 13 * 60 + 7;
+	Tally before = { 0, 0, 0, 0 }, after = { 0, 0, 0, 0 };
+	for (time_t t = start; t < end; t += step) check(t, t < 0 ? before : after);
+	row("1901-1969, sampled", before);
+	row("1970-2099, sampled", after);
+	// Every second of the hour either side of midnight, on days around
+	// 1970-1-1 and at the ends of the 32-bit range
+	static const time_t days[] = { -24856, -24855, -2, -1, 0, 1, 24854,
+								   24855 };
+	Tally edges = { 0, 0, 0, 0 };
+	for (unsigned int d = 0; d < sizeof(days)/sizeof(days[0]); d++) {
+		for (time_t s = -3600; s < 3600; s++) check(days[d] * 86400 + s, edges);
+	}
+	row("Around midnight", edges);
+	long wrong = before.gmtimeWrong + after.gmtimeWrong + edges.gmtimeWrong;
+	printf("\nThe Time library agreed on %ld of the %ld times from 1970 on "
+		   "and %ld of the %ld before\n",
+		   after.timeLibChecked - after.timeLibWrong, after.timeLibChecked,
+		   before.timeLibChecked - before.timeLibWrong,
+		   before.timeLibChecked);
+
+	printf("\n| Milliseconds           | Checked   | Differ    |\n");
+	printf("|------------------------|-----------|-----------|\n");
+	// The same span, an odd number of milliseconds apart
+	MillisTally msBefore = { 0, 0 }, msAfter = { 0, 0 };
+	const int64_t msStep = step * 1000 + 1;
+	for (int64_t ms = start * 1000; ms < end * 1000; ms += msStep) {
+		checkMillis(ms, ms < 0 ? msBefore : msAfter);
+	}
+	millisRow("1901-1969, sampled", msBefore);
+	millisRow("1970-2099, sampled", msAfter);
+	// Every millisecond of the two seconds either side of midnight on the
+	// same days, and either side of 2038-01-19 03:14:08, where a signed
+	// 32-bit count of seconds ends
+	MillisTally msEdges = { 0, 0 };
+	for (unsigned int d = 0; d < sizeof(days)/sizeof(days[0]); d++) {
+		for (int64_t ms = -2000; ms < 2000; ms++) {
+			checkMillis(days[d] * 86400000LL + ms, msEdges);
+		}
+	}
+	millisRow("Around midnight", msEdges);
+	MillisTally y2038 = { 0, 0 };
+	for (int64_t ms = -2000; ms < 2000; ms++) {
+		checkMillis(2147483648000LL + ms, y2038);
+	}
+	millisRow("Around 2038-01-19", y2038);
+	// Spread over the whole range the doubles are exact for, and at its ends
+	MillisTally far = { 0, 0 };
+	const int64_t limit = (1LL << 53) - 1;
+	uint64_t rnd = 88172645463325252ULL;
+	for (int k = 0; k < 1000000; k++) {
+		rnd ^= rnd << 13;
+		rnd ^= rnd >> 7;
+		rnd ^= rnd << 17;
+		checkMillis((int64_t)(rnd % (2 * (uint64_t)limit + 1)) - limit, far);
+	}
+	for (int64_t ms = -2000; ms < 2000; ms++) {
+		checkMillis(limit - 2000 + ms, far);
+		checkMillis(-limit + 2000 + ms, far);
+	}
+	millisRow("Within 2^53 ms", far);
+	// The last and first millisecond of days out to 2^53 ms either way,
+	// where the quotient comes nearest a whole number
+	MillisTally wholeDays = { 0, 0 };
+	const int64_t lastDay = limit / 86400000;
+	for (int64_t d = -lastDay; d <= lastDay; d += 97) {
+		checkMillis(d * 86400000 - 1, wholeDays);
+		checkMillis(d * 86400000, wholeDays);
+	}
+	millisRow("Whole days, 97 apart", wholeDays);
+	wrong += msBefore.wrong + msAfter.wrong + msEdges.wrong + y2038.wrong +
+			 far.wrong + wholeDays.wrong;
+	return wrong ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+/* sweep.cpp
+ * Check SolarSweep against calcSolarMillis() for every minute of 2024 at
+ * eight sites, for a few refresh intervals, and time the two. Runs on a
+ * desktop machine, not on an Arduino. Build from this directory:
+ *
+ * 		g++ -O2 -I../.. sweep.cpp ../../Solarlib.cpp ../../SolarKernel.cpp \
+ * 			-o sweep
+ * 		./sweep
+ *
+ * The output is the table found in README.md.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "Solarlib.h"
+#include "../common/sites.h"
+
+// Refresh intervals compared, in steps
+static const unsigned int refreshes[] = { 1, 15, 60 };
+#define NREFRESH (sizeof(refreshes)/sizeof(refreshes[0]))
+
+int main(){
+	// 2024-01-01 00:00 to 2024-12-31 23:59, local time, every minute
+	const int64_t start = 1704067200000LL;
+	const int64_t end = start + 366 * 86400000LL - 60000;
+	const int64_t step = 60000;
+	double haErr[NREFRESH] = {}, elevErr[NREFRESH] = {};
+	double corrErr[NREFRESH] = {}, azimErr[NREFRESH] = {};
+	double sweepSec[NREFRESH] = {}, scalarSec = 0;
+	long samples = 0;
+	for (unsigned int s = 0; s < NSITES; s++) {
+		SolarSite site;
+		initSolarSite(site, (int)sites[s][0], sites[s][1], sites[s][2]);
+		SolarElements SE;
+		SE.tzOffset = (int)sites[s][0];
+		SE.lat = sites[s][1];
+		SE.lon = sites[s][2];
+		SolarPosition P;
+		double check = 0;
+		// Timing, each on its own
+		for (unsigned int r = 0; r < NREFRESH; r++) {
+			SolarSweep sweep(site, start, end, step, refreshes[r]);
+			clock_t c0 = clock();
+			while (sweep.next(P)) check += P.SEC_Corr;
+			sweepSec[r] += (double)(clock() - c0) / CLOCKS_PER_SEC;
+		}
+		clock_t c0 = clock();
+		for (int64_t t = start; t <= end; t += step) {
+			calcSolarMillis(t, SE, SOLAR_REFRACTION | SOLAR_AZIMUTH);
+			check += SE.SEC_Corr;
+		}
+		scalarSec += (double)(clock() - c0) / CLOCKS_PER_SEC;
+		if (check != check) printf("NaN\n");
+		// Errors, with the sweeps running side by side
+		SolarSweep sweep0(site, start, end, step, refreshes[0]);
+		SolarSweep sweep1(site, start, end, step, refreshes[1]);
+		SolarSweep sweep2(site, start, end, step, refreshes[2]);
+		SolarSweep *sweeps[NREFRESH] = { &sweep0, &sweep1, &sweep2 };
+		for (int64_t t = start; t <= end; t += step) {
+			calcSolarMillis(t, SE);
+			for (unsigned int r = 0; r < NREFRESH; r++) {
+				sweeps[r]->next(P);
+				double e;
+				e = angleDiff(P.HA, SE.HA);
+				if (e > haErr[r]) haErr[r] = e;
+				e = absd(P.SEA - SE.SEA);
+				if (e > elevErr[r]) elevErr[r] = e;
+				// Away from the step in the refraction formula at 5 degrees
+				if (absd(SE.SEA - 5) > 0.01) {
+					e = absd(P.SEC_Corr - SE.SEC_Corr);
+					if (e > corrErr[r]) corrErr[r] = e;
+				}
+				// Azimuth is poorly defined straight up and straight down
+				if (SE.SEA > -89 && SE.SEA < 89) {
+					e = angleDiff(P.SAA, SE.SAA);
+					if (e > azimErr[r]) azimErr[r] = e;
+				}
+			}
+			samples++;
+		}
+	}
+	printf("%ld samples, largest errors relative to calcSolarMillis(), and "
+		   "time per sample\n\n", samples);
+	printf("| Refresh | HA deg   | SEA deg  | Corr deg | SAA deg  | Time   |\n");
+	printf("|---------|----------|----------|----------|----------|--------|\n");
+	for (unsigned int r = 0; r < NREFRESH; r++) {
+		printf("| %7u | %8.1e | %8.1e | %8.1e | %8.1e | %3.0f ns |\n",
+			   refreshes[r], haErr[r], elevErr[r], corrErr[r], azimErr[r],
+			   sweepSec[r] * 1e9 / samples);
+	}
+	printf("\ncalcSolarMillis(): %.0f ns per sample\n",
+		   scalarSec * 1e9 / samples);
+	return 0;
+}
@@ -0,0 +1,217 @@
+/* threads.cpp
+ * Check that calcSolarBatch(), calcSolarFleet() and calcSolarRaster() give
+ * the same output bit for bit whatever the number of threads. Each is run
+ * with setSolarThreads(1) and then with more threads, and every column is
+ * compared with memcmp(). The sizes are not whole blocks or tiles, so the
+ * last piece of work is a short one. Also runs the three from threads of
+ * its own at once, as the library allows. Runs on a desktop machine, not on
+ * an Arduino. Needs SOLARLIB_THREADS. Build from this directory:
+ *
+ * 		g++ -O2 -DSOLARLIB_THREADS -pthread -I../.. threads.cpp \
+ * 			../../Solarlib.cpp ../../SolarKernel.cpp -o threads
+ * 		./threads
+ *
+ * The output is the table found in README.md. Exits with 1 if any output
+ * differs from the single-threaded one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "Solarlib.h"
+#include "../common/sites.h"
+
+#if !defined(SOLARLIB_THREADS)
+#error Build with -DSOLARLIB_THREADS -pthread
+#endif
+
+// Every column calcSolarBatch() writes, and those the others write
+#define BATCH_COLS	SOLAR_COL_ALL
+#define FLEET_COLS	(SOLAR_COL_SDEC | SOLAR_COL_EOT | SOLAR_COL_HA | \
+					 SOLAR_COL_SZA | SOLAR_COL_SEA | SOLAR_COL_AAR | \
+					 SOLAR_COL_SEC_CORR | SOLAR_COL_SAA)
+#define RASTER_COLS	FLEET_COLS
+
+// Whether every column of a is the same, bit for bit, as that of b, for n
+// rows. NaN compares equal to the same NaN.
+static bool sameColumns(const SolarColumns &a, const SolarColumns &b,
+						size_t n){
+	const SolarBatchOut &x = a.out(), &y = b.out();
+	double *const dx[] = { x.SDec, x.EOT, x.HA, x.SZA, x.SEA, x.AAR,
+						   x.SEC_Corr, x.SAA };
+	double *const dy[] = { y.SDec, y.EOT, y.HA, y.SZA, y.SEA, y.AAR,
+						   y.SEC_Corr, y.SAA };
+	for (unsigned int c = 0; c < sizeof(dx)/sizeof(dx[0]); c++) {
+		if (dx[c] && memcmp(dx[c], dy[c], n * sizeof(double))) return false;
+	}
+	time_t *const tx[] = { x.SolarNoonTime, x.SunriseTime, x.SunsetTime };
+	time_t *const ty[] = { y.SolarNoonTime, y.SunriseTime, y.SunsetTime };
+	for (unsigned int c = 0; c < sizeof(tx)/sizeof(tx[0]); c++) {
+		if (tx[c] && memcmp(tx[c], ty[c], n * sizeof(time_t))) return false;
+	}
+	return true;
+}
+
+// Set every column to a pattern no calculation gives, so a row left
+// unwritten shows up as a difference
+static void poison(SolarColumns &cols){
+	const SolarBatchOut &o = cols.out();
+	double *const d[] = { o.SDec, o.EOT, o.HA, o.SZA, o.SEA, o.AAR,
+						  o.SEC_Corr, o.SAA };
+	for (unsigned int c = 0; c < sizeof(d)/sizeof(d[0]); c++) {
+		if (d[c]) memset(d[c], 0xA5, cols.size() * sizeof(double));
+	}
+	time_t *const t[] = { o.SolarNoonTime, o.SunriseTime, o.SunsetTime };
+	for (unsigned int c = 0; c < sizeof(t)/sizeof(t[0]); c++) {
+		if (t[c]) memset(t[c], 0xA5, cols.size() * sizeof(time_t));
+	}
+}
+
+// The inputs of every call checked
+struct Work {
+	const int64_t *minutes;	// a year, every minute
+	size_t nMinutes;
+	const int64_t *spread;	// 1901 to 2099, in no order
+	size_t nSpread;
+	const SolarSiteRegistry *fleet;
+	int64_t instant;
+	SolarGrid grid;
+};
+
+static void runBatch(const Work &w, SolarColumns &year, SolarColumns &spread){
+	calcSolarBatch(w.minutes, w.nMinutes, year);
+	calcSolarBatch(w.spread, w.nSpread, spread);
+}
+
+// Columns for everything in Work, and the day/night flags of the map
+struct Outputs {
+	SolarColumns year, spread, fleet, map;
+	uint8_t *daylight;
+	Outputs(const Work &w)
+		: year(w.nMinutes, BATCH_COLS), spread(w.nSpread, BATCH_COLS),
+		  fleet(w.fleet->size(), FLEET_COLS),
+		  map(w.grid.rows * w.grid.cols, RASTER_COLS),
+		  daylight((uint8_t *)malloc(w.grid.rows * w.grid.cols)) {}
+	~Outputs() { free(daylight); }
+	// Poison every output
+	void clear(const Work &w){
+		poison(year);
+		poison(spread);
+		poison(fleet);
+		poison(map);
+		memset(daylight, 0xA5, w.grid.rows * w.grid.cols);
+	}
+};
+
+// Run the batches (which & 1), the fleet (which & 2) and the raster
+// (which & 4) into o
+static void runAll(const Work &w, Outputs &o, int which){
+	if (which & 1) runBatch(w, o.year, o.spread);
+	if (which & 2) calcSolarFleet(w.instant, *w.fleet, o.fleet);
+	if (which & 4) calcSolarRaster(w.instant, w.grid, o.map, o.daylight);
+}
+
+static int failures = 0;
+
+// Compare o with the reference and print a table row
+static void row(const char *name, const Work &w, const Outputs &ref,
+				const Outputs &o){
+	bool year = sameColumns(o.year, ref.year, w.nMinutes);
+	bool spread = sameColumns(o.spread, ref.spread, w.nSpread);
+	bool fleet = sameColumns(o.fleet, ref.fleet, w.fleet->size());
+	size_t points = w.grid.rows * w.grid.cols;
+	bool map = sameColumns(o.map, ref.map, points) &&
+			   !memcmp(o.daylight, ref.daylight, points);
+	printf("| %-12s | %-6s | %-9s | %-6s | %-6s |\n", name,
+		   year ? "same" : "DIFF", spread ? "same" : "DIFF",
+		   fleet ? "same" : "DIFF", map ? "same" : "DIFF");
+	failures += !year + !spread + !fleet + !map;
+}
+
+int main(){
+	initSolarCalc((int)sites[0][0], sites[0][1], sites[0][2]);
+	Work w;
+	// 2024 in Monterey local time, every minute, and 17 more so the last
+	// block is short
+	w.nMinutes = 366 * 1440 + 17;
+	int64_t *minutes = (int64_t *)malloc(w.nMinutes * sizeof(int64_t));
+	for (size_t i = 0; i < w.nMinutes; i++) {
+		minutes[i] = 1704067200000LL + (int64_t)i * 60000;
+	}
+	w.minutes = minutes;
+	// Times from 1901 to 2099 in a scrambled order, so nearly every row is
+	// a new day
+	w.nSpread = 100003;
+	int64_t *spread = (int64_t *)malloc(w.nSpread * sizeof(int64_t));
+	uint32_t rnd = 2463534242UL;
+	for (size_t i = 0; i < w.nSpread; i++) {
+		rnd ^= rnd << 13;
+		rnd ^= rnd >> 17;
+		rnd ^= rnd << 5;
+		spread[i] = -2177452800000LL +
+					(int64_t)((double)rnd / 4294967296.0 * 6279811200000.0);
+	}
+	w.spread = spread;
+	// Sites on a grid over the supported latitudes, not a whole number of
+	// blocks
+	SolarSiteRegistry fleet;
+	for (double lat = -71.5; lat <= 71.5; lat += 1.1) {
+		for (double lon = -179.5; lon < 180; lon += 2.3) {
+			fleet.add((int)(lon / 15), lat, lon);
+		}
+	}
+	w.fleet = &fleet;
+	w.instant = 1718900000000LL;
+	// A third of a degree world map, rows not a whole number of tiles
+	SolarGrid grid = { 89.8, -179.8, -1.0 / 3, 1.0 / 3, 539, 1079 };
+	w.grid = grid;
+
+	Outputs ref(w), o(w);
+	ref.clear(w);
+	setSolarThreads(1);
+	runAll(w, ref, 7);
+
+	printf("%lu minutes, %lu scattered times, %lu sites, %lu by %lu map; "
+		   "%u cores\n\n", (unsigned long)w.nMinutes,
+		   (unsigned long)w.nSpread, (unsigned long)fleet.size(),
+		   (unsigned long)grid.rows, (unsigned long)grid.cols,
+		   std::thread::hardware_concurrency());
+	printf("| Threads      | Batch  | Scattered | Fleet  | Raster |\n");
+	printf("|--------------|--------|-----------|--------|--------|\n");
+	static const unsigned int counts[] = { 1, 2, 3, 4, 7, 16, 0 };
+	for (unsigned int k = 0; k < sizeof(counts)/sizeof(counts[0]); k++) {
+		setSolarThreads(counts[k]);
+		o.clear(w);
+		runAll(w, o, 7);
+		char name[16];
+		if (counts[k]) {
+			snprintf(name, sizeof(name), "%u", counts[k]);
+		} else {
+			snprintf(name, sizeof(name), "one per core");
+		}
+		row(name, w, ref, o);
+	}
+
+	// The three at once, each from a thread of its own and each splitting
+	// its work over 4 more
+	setSolarThreads(4);
+	o.clear(w);
+	std::vector<std::thread> callers;
+	for (int which = 1; which <= 4; which <<= 1) {
+		callers.push_back(std::thread(runAll, std::cref(w), std::ref(o),
+									  which));
+	}
+	for (size_t k = 0; k < callers.size(); k++) callers[k].join();
+	row("3 callers", w, ref, o);
+
+	setSolarThreads(0);
+	free(spread);
+	free(minutes);
+	if (failures) {
+		printf("\n%d outputs differ from the single-threaded ones\n",
+			   failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+/* tiers.cpp
+ * Compare calcSolar() at each accuracy tier of initSolarSite() against the
+ * full tier, which uses the C math library, over 1901 to 2099, and time
+ * each. Runs on a desktop machine, not on an Arduino. Build from this
+ * directory:
+ *
+ * 		g++ -O2 -I../.. tiers.cpp ../../Solarlib.cpp ../../SolarKernel.cpp \
+ * 			-o tiers
+ * 		./tiers
+ *
+ * The output gives the tables found in README.md.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Solarlib.h"
+#include "../common/sites.h"
+
+int main(){
+	// 1901-01-01 to 2099-12-31, stepping by an odd interval with a fraction
+	// of a second so the samples drift through every time of day
+	const int64_t start = -2177452800000LL;
+	const int64_t end = 4102358400000LL;
+	const int64_t step = (7 * 3600 + 13 * 60) * 1000LL + 137;
+	const size_t n = (size_t)((end - start) / step);
+	// Full tier results, for every site
+	SolarElements *ref = (SolarElements *)malloc(n * NSITES *
+												 sizeof(SolarElements));
+	static const int tiers[] = { SOLAR_TIER_FULL, SOLAR_TIER_FINE,
+								 SOLAR_TIER_COARSE };
+	static const char *const names[] = { "full", "fine", "coarse" };
+	printf("%lu samples, largest difference from the full tier, and time "
+		   "per calcSolarMillis() and calcSolarEphemerisMillis() call\n\n",
+		   (unsigned long)(n * NSITES));
+	printf("| Tier   | SDec deg | EOT min  | HA deg   | SEA deg  | Corr deg "
+		   "| SAA deg  | Rise s   | Time   | Ephem  |\n");
+	printf("|--------|----------|----------|----------|----------|----------"
+		   "|----------|----------|--------|--------|\n");
+	for (unsigned int k = 0; k < sizeof(tiers)/sizeof(tiers[0]); k++) {
+		double decErr = 0, eotErr = 0, haErr = 0, elevErr = 0, corrErr = 0;
+		double azimErr = 0, riseErr = 0, sec = 0, ephSec = 0;
+		long nans = 0;
+		int tier = -1;
+		for (unsigned int s = 0; s < NSITES; s++) {
+			SolarSite site;
+			initSolarSite(site, (int)sites[s][0], sites[s][1], sites[s][2],
+						  tiers[k]);
+			SolarElements SE;
+			// Timing, on its own; the best of three runs, as other work on
+			// the machine only ever adds time
+			double best = 0, check = 0;
+			for (int run = 0; run < 3; run++) {
+				clock_t c0 = clock();
+				for (size_t i = 0; i < n; i++) {
+					calcSolarMillis(start + (int64_t)i * step, site, SE);
+					check += SE.SEC_Corr;
+				}
+				double t = (double)(clock() - c0) / CLOCKS_PER_SEC;
+				if (run == 0 || t < best) best = t;
+			}
+			sec += best;
+			// The ephemeris alone, where nearly all the work is trig
+			for (int run = 0; run < 3; run++) {
+				SolarEphemeris E;
+				clock_t c0 = clock();
+				for (size_t i = 0; i < n; i++) {
+					calcSolarEphemerisMillis(start + (int64_t)i * step, E,
+											 tiers[k]);
+					check += E.SDec;
+				}
+				double t = (double)(clock() - c0) / CLOCKS_PER_SEC;
+				if (run == 0 || t < best) best = t;
+			}
+			ephSec += best;
+			if (check != check) printf("NaN\n");
+			tier = SE.tier;
+			for (size_t i = 0; i < n; i++) {
+				calcSolarMillis(start + (int64_t)i * step, site, SE);
+				SolarElements &R = ref[s * n + i];
+				if (k == 0) {
+					R = SE;
+					continue;
+				}
+				// Not a number where the full tier has one
+				if ((SE.SEC_Corr != SE.SEC_Corr && R.SEC_Corr == R.SEC_Corr) ||
+					(SE.SAA != SE.SAA && R.SAA == R.SAA) ||
+					(SE.HAS != SE.HAS && R.HAS == R.HAS)) {
+					nans++;
+				}
+				double e;
+				e = absd(SE.SDec - R.SDec);
+				if (e > decErr) decErr = e;
+				e = absd(SE.EOT - R.EOT);
+				if (e > eotErr) eotErr = e;
+				e = angleDiff(SE.HA, R.HA);
+				if (e > haErr) haErr = e;
+				e = absd(SE.SEA - R.SEA);
+				if (e > elevErr) elevErr = e;
+				// Away from the step in the refraction formula at 5 degrees
+				if (absd(R.SEA - 5) > 0.01) {
+					e = absd(SE.SEC_Corr - R.SEC_Corr);
+					if (e > corrErr) corrErr = e;
+				}
+				// Azimuth is poorly defined straight up and straight down
+				if (R.SEA > -89 && R.SEA < 89) {
+					e = angleDiff(SE.SAA, R.SAA);
+					if (e > azimErr) azimErr = e;
+				}
+				// Polar day and night give no sunrise
+				if (R.HAS == R.HAS && SE.HAS == SE.HAS) {
+					e = absd(SE.Sunrise - R.Sunrise);
+					if (e > riseErr) riseErr = e;
+				}
+			}
+		}
+		if (tier != tiers[k]) printf("results report tier %d\n", tier);
+		if (nans) printf("%ld results are NaN\n", nans);
+		printf("| %-6s | %8.1e | %8.1e | %8.1e | %8.1e | %8.1e | %8.1e "
+			   "| %8.1e | %3.0f ns | %3.0f ns |\n", names[k], decErr, eotErr,
+			   haErr, elevErr, corrErr, azimErr, riseErr,
+			   sec * 1e9 / (n * NSITES), ephSec * 1e9 / (n * NSITES));
+	}
+	free(ref);
+	return 0;
+}